@@ -0,0 +1,567 @@
+#include "Benchmark.hpp"
+#include "../mgl/mgl.hpp"
+#include "../mgl/mglSceneNode.hpp"
+#include "Headless.hpp"
+#include "JobSystem.hpp"
+#include "MyApp.hpp"
+#include "Scene.hpp"
+#include "SpatialIndex.hpp"
+#include "TransformBatch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace Benchmark {
+namespace {
+
+// --bench-scene: the pointer tree it compares Scene against.
+struct TreeNode {
+    glm::mat4 local, world;
+    glm::mat3 normal;
+    AABB meshBounds, bounds;
+    Sphere sphere;
+    const MeshBuffers* mesh;
+    glm::vec4 color;
+    mgl::ShaderProgram* shader;
+    std::vector<TreeNode*> children;
+};
+
+// Keeps every draw, in order. All nodes share one mesh, so the world matrix
+// tells which node a draw is for.
+struct RecordingSink : IDrawSink {
+    struct Draw {
+        const MeshBuffers* mesh;
+        unsigned level;
+        glm::mat4 world;
+    };
+    std::vector<Draw> draws;
+    void add(const MeshBuffers* mesh, unsigned level, mgl::ShaderProgram*, const glm::mat4& world, const glm::mat3&,
+        const glm::vec4&) override { draws.push_back({ mesh, level, world }); }
+};
+
+// Draw by draw; world matrices may differ by rounding between the kernels.
+bool sameDraws(const RecordingSink& a, const RecordingSink& b) {
+    if (a.draws.size() != b.draws.size()) return false;
+    for (size_t i = 0; i < a.draws.size(); i++) {
+        const RecordingSink::Draw& x = a.draws[i];
+        const RecordingSink::Draw& y = b.draws[i];
+        if (x.mesh != y.mesh || x.level != y.level) return false;
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                float scale = std::max(1.0f, std::abs(x.world[c][r]));
+                if (std::abs(x.world[c][r] - y.world[c][r]) > 1e-4f * scale) return false;
+            }
+        }
+    }
+    return true;
+}
+
+void updateTree(TreeNode* node, const glm::mat4& parentWorld) {
+    node->world = parentWorld * node->local;
+    node->normal = glm::transpose(glm::inverse(glm::mat3(node->world)));
+    node->meshBounds = node->mesh ? node->mesh->bounds().transformed(node->world) : AABB();
+    node->sphere = node->mesh ? node->mesh->sphere().transformed(node->world) : Sphere();
+    node->bounds = node->meshBounds;
+    for (TreeNode* child : node->children) {
+        updateTree(child, node->world);
+        node->bounds.expand(child->bounds);
+    }
+}
+
+void drawTree(const TreeNode* node, const Frustum& frustum, bool inside, IDrawSink& sink) {
+    if (!inside) {
+        Frustum::Result result = frustum.test(node->bounds);
+        if (result == Frustum::OUTSIDE) return;
+        inside = result == Frustum::INSIDE;
+    }
+    if (node->mesh && (inside || (frustum.intersects(node->sphere) && frustum.test(node->meshBounds) != Frustum::OUTSIDE))) {
+        sink.add(node->mesh, 0, node->shader, node->world, node->normal, node->color);
+    }
+    for (const TreeNode* child : node->children) drawTree(child, frustum, inside, sink);
+}
+
+}
+
+int scene(int count) {
+    if (count <= 0) return EXIT_FAILURE;
+    HeadlessContext context;
+    if (!context.create(64, 64, 4, 5)) return EXIT_FAILURE;
+
+    // A unit cube is enough: only its bounds matter here.
+    MeshBuffers::Vertex cube[8];
+    for (int i = 0; i < 8; i++) {
+        cube[i] = MeshBuffers::Vertex();
+        cube[i].position = glm::vec3(i & 1, (i >> 1) & 1, (i >> 2) & 1) - 0.5f;
+    }
+    GLuint indices[3] = { 0, 1, 2 };
+    MeshBuffers mesh;
+    mesh.create(cube, 8, indices, 3);
+    // Scene only keeps the mesh of nodes that have a shader; it is never bound.
+    mgl::ShaderProgram shader;
+
+    // Groups of 100 under 10 top-level groups, laid out on a plane.
+    const int groupSize = 100;
+    std::deque<mgl::SceneNode> handles;
+    std::vector<TreeNode*> tree;
+    Scene scene;
+    scene.reserve(count + count / groupSize + 11);
+    std::vector<TreeNode*> roots;
+    mgl::SceneNode* top = nullptr;
+    mgl::SceneNode* group = nullptr;
+    TreeNode* topTree = nullptr;
+    TreeNode* groupTree = nullptr;
+    auto make = [&](mgl::SceneNode* parent, TreeNode* parentTree, const glm::mat4& local, const MeshBuffers* m) {
+        handles.emplace_back(nullptr, &shader);
+        mgl::SceneNode* handle = &handles.back();
+        handle->transform = local;
+        scene.add(handle, parent, m, glm::vec4(1.0f), &shader);
+        TreeNode* node = new TreeNode{ local, glm::mat4(1.0f), glm::mat3(1.0f), AABB(), AABB(), Sphere(), m, glm::vec4(1.0f), &shader, {} };
+        if (parentTree) parentTree->children.push_back(node);
+        else roots.push_back(node);
+        tree.push_back(node);
+        return std::make_pair(handle, node);
+    };
+    int groups = (count + groupSize - 1) / groupSize;
+    int groupsPerTop = std::max(1, groups / 10);
+    for (int i = 0; i < count; i++) {
+        int g = i / groupSize;
+        if (i % groupSize == 0) {
+            if (g % groupsPerTop == 0) {
+                auto t = make(nullptr, nullptr, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 40.0f * (g / groupsPerTop))), nullptr);
+                top = t.first;
+                topTree = t.second;
+            }
+            auto n = make(top, topTree, glm::translate(glm::mat4(1.0f), glm::vec3(40.0f * (g % groupsPerTop), 0.0f, 0.0f)), nullptr);
+            group = n.first;
+            groupTree = n.second;
+        }
+        int k = i % groupSize;
+        make(group, groupTree, glm::translate(glm::mat4(1.0f), glm::vec3(3.0f * (k % 10), 0.0f, 3.0f * (k / 10))), &mesh);
+    }
+    glm::mat4 view = glm::lookAt(glm::vec3(-20.0f, 30.0f, -20.0f), glm::vec3(60.0f, 0.0f, 60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum(glm::perspective(glm::radians(30.0f), 4.0f / 3.0f, 1.0f, 200.0f) * view);
+
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    const int runs = 20;
+    double treeUpdate = 0, treeDraw = 0, flatUpdate = 0, flatDraw = 0, jobsUpdate = 0, jobsDraw = 0;
+    RecordingSink treeSink, flatSink, jobsSink;
+    for (RecordingSink* sink : { &treeSink, &flatSink, &jobsSink }) sink->draws.reserve(count);
+    JobSystem jobs;
+    for (int r = 0; r < runs; r++) {
+        auto t0 = clock::now();
+        for (TreeNode* root : roots) updateTree(root, glm::mat4(1.0f));
+        auto t1 = clock::now();
+        treeSink.draws.clear();
+        for (TreeNode* root : roots) drawTree(root, frustum, false, treeSink);
+        auto t2 = clock::now();
+        scene.invalidateBounds();
+        scene.update();
+        auto t3 = clock::now();
+        flatSink.draws.clear();
+        scene.draw(flatSink, &frustum);
+        auto t4 = clock::now();
+        scene.setJobSystem(&jobs);
+        scene.invalidateBounds();
+        scene.update();
+        auto t5 = clock::now();
+        jobsSink.draws.clear();
+        scene.draw(jobsSink, &frustum);
+        auto t6 = clock::now();
+        scene.setJobSystem(nullptr);
+        treeUpdate += ms(t0, t1);
+        treeDraw += ms(t1, t2);
+        flatUpdate += ms(t2, t3);
+        flatDraw += ms(t3, t4);
+        jobsUpdate += ms(t4, t5);
+        jobsDraw += ms(t5, t6);
+    }
+
+    std::printf("%zu nodes, %zu drawn (tree %zu), average of %d runs\n", scene.size(), flatSink.draws.size(),
+        treeSink.draws.size(), runs);
+    std::printf("  pointer tree: update %.3f ms, traversal %.3f ms\n", treeUpdate / runs, treeDraw / runs);
+    std::printf("  flat scene:   update %.3f ms, traversal %.3f ms\n", flatUpdate / runs, flatDraw / runs);
+    std::printf("  %u threads:    update %.3f ms, traversal %.3f ms\n", jobs.threadCount(), jobsUpdate / runs,
+        jobsDraw / runs);
+    for (TreeNode* node : tree) delete node;
+    bool same = sameDraws(flatSink, treeSink) && sameDraws(jobsSink, flatSink);
+    if (!same) std::printf("  traversals differ\n");
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int transforms(int count) {
+    if (count <= 0) return EXIT_FAILURE;
+
+    std::mt19937 rng(12345);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::vector<glm::vec3> position(count), angles(count), scale(count);
+    std::vector<glm::quat> rotation(count);
+    std::vector<int> parent(count);
+    for (int i = 0; i < count; i++) {
+        position[i] = glm::vec3(unit(rng), unit(rng), unit(rng)) * 10.0f;
+        angles[i] = glm::vec3(unit(rng), unit(rng), unit(rng)) * 180.0f;
+        scale[i] = glm::vec3(unit(rng), unit(rng), unit(rng)) * 0.25f + 1.0f;
+        rotation[i] = glm::angleAxis(glm::radians(angles[i].x), glm::vec3(1, 0, 0))
+            * glm::angleAxis(glm::radians(angles[i].y), glm::vec3(0, 1, 0))
+            * glm::angleAxis(glm::radians(angles[i].z), glm::vec3(0, 0, 1));
+        // Shallow random hierarchy, parents first.
+        parent[i] = i % 64 == 0 ? -1 : i - 1 - (int)(rng() % std::min(i % 64, 8));
+    }
+
+    // Reference: the chained glm calls MyApp::getModel used per node.
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    std::vector<glm::mat4> local(count), world(count), expectedLocal(count), expectedWorld(count);
+    auto t0 = clock::now();
+    for (int i = 0; i < count; i++) {
+        expectedLocal[i] = glm::translate(glm::mat4(1.0f), position[i])
+            * glm::rotate(glm::mat4(1.0f), glm::radians(angles[i].x), glm::vec3(1, 0, 0))
+            * glm::rotate(glm::mat4(1.0f), glm::radians(angles[i].y), glm::vec3(0, 1, 0))
+            * glm::rotate(glm::mat4(1.0f), glm::radians(angles[i].z), glm::vec3(0, 0, 1))
+            * glm::scale(glm::mat4(1.0f), scale[i]);
+    }
+    auto t1 = clock::now();
+    for (int i = 0; i < count; i++) {
+        expectedWorld[i] = parent[i] < 0 ? expectedLocal[i] : expectedWorld[parent[i]] * expectedLocal[i];
+    }
+    auto t2 = clock::now();
+    std::printf("%d nodes\n", count);
+    std::printf("  glm:    compose %.3f ms, propagate %.3f ms\n", ms(t0, t1), ms(t1, t2));
+
+    // Relative to the magnitude of each element; rotations go through
+    // quaternions here, so bit-exact results are not expected.
+    auto maxError = [count](const std::vector<glm::mat4>& a, const std::vector<glm::mat4>& b) {
+        float error = 0.0f;
+        for (int i = 0; i < count; i++) {
+            for (int c = 0; c < 4; c++) {
+                for (int r = 0; r < 4; r++) {
+                    error = std::max(error, std::fabs(a[i][c][r] - b[i][c][r]) / (1.0f + std::fabs(b[i][c][r])));
+                }
+            }
+        }
+        return error;
+    };
+    const float tolerance = 1e-4f;
+    const int runs = 20;
+    bool ok = true;
+    TransformBatch::Kernel best = TransformBatch::bestKernel();
+    for (int k = TransformBatch::SCALAR; k <= best; k++) {
+        TransformBatch::setKernel((TransformBatch::Kernel)k);
+        double composeTime = 0, propagateTime = 0;
+        for (int r = 0; r < runs; r++) {
+            auto a = clock::now();
+            TransformBatch::compose(position.data(), rotation.data(), scale.data(), local.data(), count);
+            auto b = clock::now();
+            TransformBatch::propagate(parent.data(), local.data(), world.data(), count);
+            auto c = clock::now();
+            composeTime += ms(a, b);
+            propagateTime += ms(b, c);
+        }
+        float localError = maxError(local, expectedLocal);
+        float worldError = maxError(world, expectedWorld);
+        bool pass = localError <= tolerance && worldError <= tolerance;
+        ok = ok && pass;
+        std::printf("  %-6s compose %.3f ms, propagate %.3f ms, max error %.2g / %.2g %s\n",
+            TransformBatch::kernelName((TransformBatch::Kernel)k), composeTime / runs, propagateTime / runs,
+            localError, worldError, pass ? "ok" : "FAILED");
+    }
+    TransformBatch::setKernel(best);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int spatial(int count) {
+    std::vector<int> counts = { 1000, 10000, 100000 };
+    if (count > 0) counts = { count };
+
+    using clock = std::chrono::steady_clock;
+    auto us = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::micro>(b - a).count(); };
+    bool ok = true;
+    for (int n : counts) {
+        // Boxes of 1 to 3 units, about 3 apart on a plane, as in --bench-scene.
+        std::mt19937 rng(12345);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        float side = 3.0f * std::sqrt((float)n);
+        std::vector<AABB> boxes(n);
+        for (AABB& box : boxes) {
+            glm::vec3 center(unit(rng) * side, unit(rng) * 2.0f, unit(rng) * side);
+            glm::vec3 half = glm::vec3(unit(rng), unit(rng), unit(rng)) + 0.5f;
+            box.min = center - half;
+            box.max = center + half;
+        }
+
+        SpatialIndex index;
+        std::vector<int> proxies(n);
+        auto t0 = clock::now();
+        for (int i = 0; i < n; i++) proxies[i] = index.insert(boxes[i], i);
+        auto t1 = clock::now();
+        double insertTime = us(t0, t1);
+
+        // Small moves mostly stay inside the enlarged boxes; large ones
+        // always reinsert.
+        double moveTime[2];
+        int reinserted[2] = { 0, 0 };
+        const float steps[2] = { 0.02f, 5.0f };
+        for (int m = 0; m < 2; m++) {
+            std::vector<glm::vec3> offsets(n);
+            for (glm::vec3& d : offsets) d = glm::vec3(unit(rng) - 0.5f, 0.0f, unit(rng) - 0.5f) * steps[m];
+            auto a = clock::now();
+            for (int i = 0; i < n; i++) {
+                boxes[i].min += offsets[i];
+                boxes[i].max += offsets[i];
+                if (index.move(proxies[i], boxes[i])) reinserted[m]++;
+            }
+            moveTime[m] = us(a, clock::now());
+        }
+
+        // Query shapes at random places: a 10-unit box, a candle light's
+        // sphere, a camera frustum and a picking ray.
+        const int queries = 1000;
+        std::vector<glm::vec3> places(queries);
+        for (glm::vec3& p : places) p = glm::vec3(unit(rng) * side, 1.0f, unit(rng) * side);
+        glm::mat4 projection = glm::perspective(glm::radians(30.0f), 4.0f / 3.0f, 1.0f, 60.0f);
+        auto queryBox = [&](int q) {
+            AABB box;
+            box.min = places[q] - glm::vec3(5.0f);
+            box.max = places[q] + glm::vec3(5.0f);
+            return box;
+        };
+        auto querySphere = [&](int q) { return Sphere{ places[q], 12.0f }; };
+        auto queryFrustum = [&](int q) {
+            glm::vec3 eye = places[q] + glm::vec3(0.0f, 20.0f, 0.0f);
+            glm::vec3 at = places[q] + glm::vec3(30.0f, 0.0f, 30.0f);
+            return Frustum(projection * glm::lookAt(eye, at, glm::vec3(0.0f, 1.0f, 0.0f)));
+        };
+        auto queryRay = [&](int q) {
+            return Ray(places[q] + glm::vec3(0.0f, 30.0f, 0.0f), glm::normalize(glm::vec3(1.0f, -1.0f, 0.5f)));
+        };
+
+        std::printf("%d boxes, tree height %d\n", n, index.height());
+        std::printf("  insert %.3f us, move %.3f us (%d reinserted), move far %.3f us (%d reinserted)\n",
+            insertTime / n, moveTime[0] / n, reinserted[0], moveTime[1] / n, reinserted[1]);
+
+        std::vector<int> found, scanned;
+        std::vector<SpatialIndex::RayHit> rayHits;
+        std::vector<uint8_t> mark(n);
+        const char* names[4] = { "box", "sphere", "frustum", "ray" };
+        for (int kind = 0; kind < 4; kind++) {
+            double indexTime = 0, scanTime = 0;
+            size_t results = 0, exact = 0;
+            for (int q = 0; q < queries; q++) {
+                // Shapes are built outside the timed part.
+                AABB box = queryBox(q);
+                Sphere sphere = querySphere(q);
+                Frustum frustum = queryFrustum(q);
+                Ray ray = queryRay(q);
+                // Exact tests of one box, for the scan and to check the index.
+                auto hits = [&](const AABB& b) {
+                    if (kind == 0) {
+                        return b.min.x <= box.max.x && box.min.x <= b.max.x && b.min.y <= box.max.y
+                            && box.min.y <= b.max.y && b.min.z <= box.max.z && box.min.z <= b.max.z;
+                    }
+                    if (kind == 1) {
+                        glm::vec3 d = glm::clamp(sphere.center, b.min, b.max) - sphere.center;
+                        return glm::dot(d, d) <= sphere.radius * sphere.radius;
+                    }
+                    if (kind == 2) return frustum.test(b) != Frustum::OUTSIDE;
+                    float t;
+                    return ray.intersects(b, std::numeric_limits<float>::max(), t);
+                };
+                found.clear();
+                rayHits.clear();
+                auto a = clock::now();
+                switch (kind) {
+                case 0: index.query(box, found); break;
+                case 1: index.query(sphere, found); break;
+                case 2: index.query(frustum, found); break;
+                default: index.raycast(ray, std::numeric_limits<float>::max(), rayHits); break;
+                }
+                auto b = clock::now();
+                scanned.clear();
+                for (int i = 0; i < n; i++) {
+                    if (hits(boxes[i])) scanned.push_back(i);
+                }
+                auto c = clock::now();
+                indexTime += us(a, b);
+                scanTime += us(b, c);
+
+                for (const SpatialIndex::RayHit& hit : rayHits) found.push_back(hit.data);
+                results += found.size();
+                exact += scanned.size();
+                for (int i : found) mark[i] = 1;
+                for (int i : scanned) ok = ok && mark[i];
+                for (int i : found) mark[i] = 0;
+            }
+            std::printf("  %-8s index %.3f us, scan %.3f us, %.1f found (%.1f exact)\n", names[kind],
+                indexTime / queries, scanTime / queries, (double)results / queries, (double)exact / queries);
+        }
+    }
+    if (!ok) std::printf("The index missed boxes the scan found\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int lights(int argc, char* argv[]) {
+    int frames = 120, width = 800, height = 600;
+    const char* scenePath = nullptr;
+    for (int i = 0; i < argc; i++) {
+        if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) scenePath = argv[++i];
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) std::sscanf(argv[++i], "%dx%d", &width, &height);
+        else {
+            std::cerr << "Unknown benchmark option " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (frames <= 0 || width <= 0 || height <= 0) return EXIT_FAILURE;
+
+    HeadlessContext context;
+    if (!context.create(width, height, 4, 5)) return EXIT_FAILURE;
+    GLFWwindow* win = context.window();
+
+    MyApp app;
+    if (scenePath) app.setScenePath(scenePath);
+    app.setOnDemand(false);
+    app.initCallback(win);
+    app.windowSizeCallback(win, width, height);
+    while (app.meshesLoading()) {
+        context.beginFrame();
+        app.displayCallback(win, 0.0);
+    }
+
+    using clock = std::chrono::steady_clock;
+    std::printf("%d frames per run at %dx%d\n", frames, width, height);
+    std::printf("%7s %9s %9s %11s %11s\n", "lights", "per tile", "max tile", "tiled ms", "1 tile ms");
+    for (int count = 1; count <= 1024; count *= 2) {
+        app.setExtraLights(count, 7);
+        double ms[2];
+        float perTile = 0.0f;
+        int maxPerTile = 0;
+        for (int run = 0; run < 2; run++) {
+            app.setLightTileSize(run == 0 ? LightGrid::TILE_SIZE : 0);
+            double total = 0.0;
+            for (int i = 0; i < frames; i++) {
+                app.setOrbit(glm::two_pi<float>() * i / frames, 0.5f, 8.0f);
+                auto start = clock::now();
+                context.beginFrame();
+                app.displayCallback(win, 1.0 / 60.0);
+                glFinish();
+                total += std::chrono::duration<double, std::milli>(clock::now() - start).count();
+            }
+            ms[run] = total / frames;
+            if (run == 0) {
+                perTile = app.lightList().averagePerTile();
+                maxPerTile = app.lightList().maxPerTile();
+            }
+        }
+        std::printf("%7d %9.1f %9d %11.3f %11.3f\n", count, perTile, maxPerTile, ms[0], ms[1]);
+    }
+    app.windowCloseCallback(win);
+    return EXIT_SUCCESS;
+}
+
+int run(int argc, char* argv[]) {
+    int frames = 600, width = 800, height = 600;
+    const char* checksumPath = nullptr;
+    const char* verifyPath = nullptr;
+    const char* scenePath = nullptr;
+    for (int i = 0; i < argc; i++) {
+        if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) scenePath = argv[++i];
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) std::sscanf(argv[++i], "%dx%d", &width, &height);
+        else if (std::strcmp(argv[i], "--checksums") == 0 && i + 1 < argc) checksumPath = argv[++i];
+        else if (std::strcmp(argv[i], "--verify") == 0 && i + 1 < argc) verifyPath = argv[++i];
+        else {
+            std::cerr << "Unknown benchmark option " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (frames <= 0 || width <= 0 || height <= 0) return EXIT_FAILURE;
+
+    HeadlessContext context;
+    if (!context.create(width, height, 4, 5)) return EXIT_FAILURE;
+    GLFWwindow* win = context.window();
+
+    MyApp app;
+    if (scenePath) app.setScenePath(scenePath);
+    app.setOnDemand(false);
+    app.initCallback(win);
+    app.windowSizeCallback(win, width, height);
+    while (app.meshesLoading()) {
+        context.beginFrame();
+        app.displayCallback(win, 0.0);
+    }
+
+    using clock = std::chrono::steady_clock;
+    const double step = 1.0 / 60.0;
+    std::vector<double> times;
+    std::vector<uint64_t> checksums;
+    uint64_t steadyAllocations = 0;
+    times.reserve(frames);
+    for (int i = 0; i < frames; i++) {
+        float t = (float)i / frames;
+        float yaw = glm::two_pi<float>() * t;
+        float pitch = 0.35f + 0.25f * std::sin(2.0f * glm::two_pi<float>() * t);
+        float radius = 6.0f + 3.0f * std::sin(glm::two_pi<float>() * t);
+        app.setOrbit(yaw, pitch, radius);
+
+        auto start = clock::now();
+        context.beginFrame();
+        app.displayCallback(win, step);
+        glFinish();
+        times.push_back(std::chrono::duration<double, std::milli>(clock::now() - start).count());
+        if (i >= frames / 2) steadyAllocations += app.frameAllocations();
+
+        if (checksumPath || verifyPath) checksums.push_back(context.checksum());
+    }
+    app.windowCloseCallback(win);
+
+    std::vector<double> sorted(times);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double v : sorted) sum += v;
+    double avg = sum / frames;
+    std::printf("Frames: %d at %dx%d\n", frames, width, height);
+    std::printf("Frame time: min %.3f ms, avg %.3f ms (%.1f fps), p50 %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        sorted.front(), avg, 1000.0 / avg, sorted[frames / 2],
+        sorted[std::min(frames - 1, (int)(0.99 * frames))], sorted.back());
+    std::printf("Heap allocations: %llu in the last %d frames\n", (unsigned long long)steadyAllocations,
+        frames - frames / 2);
+
+    if (checksumPath) {
+        std::ofstream out(checksumPath);
+        for (int i = 0; i < frames; i++) out << i << " " << std::hex << checksums[i] << std::dec << "\n";
+        std::cout << "Checksums written to " << checksumPath << std::endl;
+    }
+
+    int mismatches = 0;
+    if (verifyPath) {
+        std::ifstream in(verifyPath);
+        if (!in) {
+            std::cerr << "Cannot read " << verifyPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        int frame;
+        uint64_t expected;
+        int compared = 0;
+        while (in >> std::dec >> frame >> std::hex >> expected) {
+            if (frame < 0 || frame >= frames) continue;
+            compared++;
+            if (checksums[frame] != expected && mismatches++ < 10) {
+                std::cerr << "Frame " << frame << " differs" << std::endl;
+            }
+        }
+        std::cout << "Verified " << compared << " frames, " << mismatches << " mismatches" << std::endl;
+    }
+    return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+// Offline benchmarks and checks, run from the command line instead of the
+// viewer (see main). Each returns the process exit code.
+namespace Benchmark {
+
+// --bench [--scene file] [--frames N] [--size WxH] [--checksums out.txt] [--verify expected.txt]
+// Renders the scene offscreen while the camera orbits along a fixed path,
+// then prints frame-time statistics and the heap allocations of the second
+// half of the frames, which should be 0. Checksums of every frame can be
+// written, or compared against a previous run (exit code 1 on mismatch).
+int run(int argc, char* argv[]);
+
+// --bench-lights [--scene file] [--frames N] [--size WxH]
+// Renders the scene offscreen with 1 to 1024 extra lights, binned into
+// 16-pixel tiles and into one tile for the whole screen (every fragment then
+// visits every visible light), and prints the average frame time of each.
+int lights(int argc, char* argv[]);
+
+// --bench-scene [N]: compares world-matrix propagation and culled traversal
+// of N nodes in Scene (flat arrays) against a pointer tree laid out like
+// the previous scene graph (one heap node per SceneNode, children reached
+// through pointers, recursive traversal), and Scene on one thread against
+// Scene on a JobSystem. All must emit the same draws in the same order
+// (exit code 1 otherwise).
+int scene(int count);
+
+// --bench-transforms [N]: checks every transform kernel this CPU supports
+// against the glm path on N random nodes (exit code 1 if any differs by more
+// than the tolerance), then times them against chained glm calls.
+int transforms(int count);
+
+// --bench-spatial [N]: times SpatialIndex inserts, moves and queries over N
+// boxes (1k, 10k and 100k without N), and the same queries as a linear scan
+// of every box. Exit code 1 if the index misses a box the scan finds.
+int spatial(int count);
+
+}
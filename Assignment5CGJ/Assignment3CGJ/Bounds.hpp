@@ -0,0 +1,85 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <limits>
+#include <algorithm>
+
+// Axis-aligned box; an empty box has min > max so that any expand() fixes it.
+struct AABB {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    bool isEmpty() const { return min.x > max.x; }
+
+    void expand(const glm::vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const AABB& b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return max - min; }
+
+    float surfaceArea() const {
+        if (isEmpty()) return 0.0f;
+        glm::vec3 e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    // Box around this box after an affine transform (Arvo's method).
+    AABB transformed(const glm::mat4& m) const {
+        if (isEmpty()) return *this;
+        AABB r;
+        r.min = r.max = glm::vec3(m[3]);
+        for (int i = 0; i < 3; i++) {
+            glm::vec3 a = glm::vec3(m[i]) * min[i];
+            glm::vec3 b = glm::vec3(m[i]) * max[i];
+            r.min += glm::min(a, b);
+            r.max += glm::max(a, b);
+        }
+        return r;
+    }
+};
+
+// Bounding sphere; a negative radius marks it as empty.
+struct Sphere {
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = -1.0f;
+
+    bool isEmpty() const { return radius < 0.0f; }
+
+    // Sphere after an affine transform, scaled by the largest axis scale.
+    Sphere transformed(const glm::mat4& m) const {
+        if (isEmpty()) return *this;
+        float scale = std::max(std::max(glm::length(glm::vec3(m[0])), glm::length(glm::vec3(m[1]))),
+            glm::length(glm::vec3(m[2])));
+        return { glm::vec3(m * glm::vec4(center, 1.0f)), radius * scale };
+    }
+};
+
+// Ray with a precomputed reciprocal direction for slab tests.
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 invDirection;
+
+    Ray() = default;
+    Ray(const glm::vec3& o, const glm::vec3& d)
+        : origin(o), direction(d), invDirection(1.0f / d.x, 1.0f / d.y, 1.0f / d.z) {
+    }
+
+    // Slab test; returns the entry distance in tNear when the box is hit before tMax.
+    bool intersects(const AABB& box, float tMax, float& tNear) const {
+        glm::vec3 t0 = (box.min - origin) * invDirection;
+        glm::vec3 t1 = (box.max - origin) * invDirection;
+        glm::vec3 tmin = glm::min(t0, t1);
+        glm::vec3 tmax = glm::max(t0, t1);
+        float enter = std::max(std::max(tmin.x, tmin.y), std::max(tmin.z, 0.0f));
+        float exit = std::min(std::min(tmax.x, tmax.y), std::min(tmax.z, tMax));
+        tNear = enter;
+        return enter <= exit;
+    }
+};
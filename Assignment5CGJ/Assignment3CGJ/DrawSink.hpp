@@ -0,0 +1,14 @@
+#pragma once
+#include "../mgl/mgl.hpp"
+#include "MeshBuffers.hpp"
+
+// Receives the draws produced by a scene traversal. Implementations decide
+// how they are issued (sorted one by one, or grouped into instanced draws).
+// `level` picks the mesh's level of detail; `normal` is the inverse
+// transpose of the upper 3x3 of `world`.
+class IDrawSink {
+public:
+    virtual ~IDrawSink() = default;
+    virtual void add(const MeshBuffers* mesh, unsigned level, mgl::ShaderProgram* shader, const glm::mat4& world,
+        const glm::mat3& normal, const glm::vec4& color) = 0;
+};
@@ -0,0 +1,145 @@
+#include "FileWatcher.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+// Without inotify, how often the files are checked.
+static const std::chrono::milliseconds SCAN_INTERVAL(500);
+
+// How long a file must go without further changes before it is reported.
+static const std::chrono::milliseconds SETTLE_TIME(200);
+
+FileWatcher::FileWatcher() {
+#ifdef __linux__
+    fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+    clear();
+#ifdef __linux__
+    if (fd_ >= 0) close(fd_);
+#endif
+}
+
+bool FileWatcher::native() const {
+#ifdef __linux__
+    return fd_ >= 0;
+#else
+    return false;
+#endif
+}
+
+void FileWatcher::watch(const std::string& path) {
+    for (const File& f : files_) {
+        if (f.path == path) return;
+    }
+    File file;
+    file.path = path;
+    size_t slash = path.find_last_of("/\\");
+    file.directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    file.name = slash == std::string::npos ? path : path.substr(slash + 1);
+    stat(file);
+    files_.push_back(file);
+
+#ifdef __linux__
+    if (fd_ < 0) return;
+    for (const auto& d : directories_) {
+        if (d.second == file.directory) return;
+    }
+    int wd = inotify_add_watch(fd_, file.directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+    if (wd >= 0) directories_.push_back({ wd, file.directory });
+#endif
+}
+
+void FileWatcher::clear() {
+    files_.clear();
+#ifdef __linux__
+    for (const auto& d : directories_) inotify_rm_watch(fd_, d.first);
+    directories_.clear();
+#endif
+}
+
+// Records the file's modification time and size; true if they changed.
+// Times finer than a second catch two saves of the same size in a row.
+bool FileWatcher::stat(File& file) const {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(file.path.c_str(), GetFileExInfoStandard, &info)) return false;
+    int64_t modified = ((int64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+    int64_t size = ((int64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+#else
+    struct stat info;
+    if (::stat(file.path.c_str(), &info) != 0) return false;
+    int64_t modified = (int64_t)info.st_mtime * 1000000000;
+#ifdef __GLIBC__
+    modified += info.st_mtim.tv_nsec;
+#endif
+    int64_t size = (int64_t)info.st_size;
+#endif
+    bool changed = modified != file.modified || size != file.size;
+    file.modified = modified;
+    file.size = size;
+    return changed;
+}
+
+void FileWatcher::scan(Clock::time_point now) {
+    if (now - lastScan_ < SCAN_INTERVAL) return;
+    lastScan_ = now;
+    for (File& f : files_) {
+        if (stat(f)) {
+            f.changed = true;
+            f.changedAt = now;
+        }
+    }
+}
+
+void FileWatcher::readEvents(Clock::time_point now) {
+#ifdef __linux__
+    alignas(struct inotify_event) char buffer[4096];
+    for (;;) {
+        ssize_t length = read(fd_, buffer, sizeof(buffer));
+        if (length <= 0) break;
+        for (char* p = buffer; p < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0) continue;
+            const std::string* directory = nullptr;
+            for (const auto& d : directories_) {
+                if (d.first == event->wd) directory = &d.second;
+            }
+            if (!directory) continue;
+            for (File& f : files_) {
+                if (f.directory == *directory && f.name == event->name) {
+                    f.changed = true;
+                    f.changedAt = now;
+                }
+            }
+        }
+    }
+#else
+    (void)now;
+#endif
+}
+
+void FileWatcher::poll(std::vector<std::string>& changed) {
+    Clock::time_point now = Clock::now();
+    if (native()) readEvents(now);
+    else scan(now);
+
+    for (File& f : files_) {
+        if (f.changed && now - f.changedAt >= SETTLE_TIME) {
+            f.changed = false;
+            changed.push_back(f.path);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Reports files that changed on disk. On Linux inotify watches the files'
+// directories, since editors often save by writing a new file and renaming
+// it over the old one; elsewhere the modification times are polled every
+// half second. A file is reported once it has been quiet for a moment, so a
+// save written in several steps is read whole.
+class FileWatcher {
+public:
+    FileWatcher();
+    ~FileWatcher();
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    void watch(const std::string& path);
+    void clear();
+
+    // Appends the paths (as given to watch()) that changed since they were
+    // last reported. Cheap enough to call every frame.
+    void poll(std::vector<std::string>& changed);
+
+    // False when falling back to polling.
+    bool native() const;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct File {
+        std::string path;
+        std::string directory;
+        std::string name;
+        int64_t modified = 0;
+        int64_t size = -1;
+        bool changed = false;
+        Clock::time_point changedAt;
+    };
+
+    std::vector<File> files_;
+    Clock::time_point lastScan_;
+#ifdef __linux__
+    int fd_ = -1;
+    std::vector<std::pair<int, std::string>> directories_;     // watch descriptor, directory
+#endif
+
+    bool stat(File& file) const;
+    void scan(Clock::time_point now);
+    void readEvents(Clock::time_point now);
+};
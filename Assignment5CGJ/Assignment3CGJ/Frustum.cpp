@@ -0,0 +1,41 @@
+#include "Frustum.hpp"
+
+void Frustum::extract(const glm::mat4& m) {
+    glm::vec4 row[4];
+    for (int i = 0; i < 4; i++) row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+    planes_[0] = row[3] + row[0];  // left
+    planes_[1] = row[3] - row[0];  // right
+    planes_[2] = row[3] + row[1];  // bottom
+    planes_[3] = row[3] - row[1];  // top
+    planes_[4] = row[3] + row[2];  // near
+    planes_[5] = row[3] - row[2];  // far
+    for (glm::vec4& p : planes_) p = p / glm::length(glm::vec3(p));
+}
+
+Frustum::Result Frustum::test(const AABB& box) const {
+    if (box.isEmpty()) return OUTSIDE;
+
+    Result result = INSIDE;
+    for (const glm::vec4& p : planes_) {
+        glm::vec3 n(p);
+        // Corner furthest along the plane normal, and the one opposite it.
+        glm::vec3 positive(n.x >= 0.0f ? box.max.x : box.min.x,
+            n.y >= 0.0f ? box.max.y : box.min.y,
+            n.z >= 0.0f ? box.max.z : box.min.z);
+        glm::vec3 negative(n.x >= 0.0f ? box.min.x : box.max.x,
+            n.y >= 0.0f ? box.min.y : box.max.y,
+            n.z >= 0.0f ? box.min.z : box.max.z);
+        if (glm::dot(n, positive) + p.w < 0.0f) return OUTSIDE;
+        if (glm::dot(n, negative) + p.w < 0.0f) result = INTERSECTS;
+    }
+    return result;
+}
+
+bool Frustum::intersects(const Sphere& sphere) const {
+    if (sphere.isEmpty()) return false;
+    for (const glm::vec4& p : planes_) {
+        if (glm::dot(glm::vec3(p), sphere.center) + p.w < -sphere.radius) return false;
+    }
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "Bounds.hpp"
+
+// Six clip planes taken from a projection * view matrix (Gribb-Hartmann),
+// so perspective and orthographic cameras are handled alike. Planes point
+// inwards and are normalised.
+class Frustum {
+public:
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+    Frustum() = default;
+    explicit Frustum(const glm::mat4& viewProjection) { extract(viewProjection); }
+
+    void extract(const glm::mat4& viewProjection);
+
+    Result test(const AABB& box) const;
+    bool intersects(const Sphere& sphere) const;
+
+private:
+    glm::vec4 planes_[6];
+};
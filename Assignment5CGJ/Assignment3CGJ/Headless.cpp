@@ -0,0 +1,110 @@
+#include "Headless.hpp"
+#include <iostream>
+
+HeadlessContext::~HeadlessContext() {
+    destroy();
+}
+
+bool HeadlessContext::openWindow(bool software, int glMajor, int glMinor) {
+#ifdef GLFW_PLATFORM_NULL
+    if (software) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#else
+    if (software) return false;
+#endif
+    if (!glfwInit()) return false;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, glMajor);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, glMinor);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+    if (software) glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+
+    window_ = glfwCreateWindow(width_, height_, "headless", nullptr, nullptr);
+    if (!window_) {
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(window_);
+    return true;
+}
+
+bool HeadlessContext::create(int width, int height, int glMajor, int glMinor) {
+    width_ = width;
+    height_ = height;
+    if (!openWindow(false, glMajor, glMinor) && !openWindow(true, glMajor, glMinor)) {
+        std::cerr << "Cannot create an offscreen OpenGL " << glMajor << "." << glMinor << " context" << std::endl;
+        return false;
+    }
+
+    // GLEW cannot query GLX without a display, but the core entry points load fine.
+    glewExperimental = GL_TRUE;
+    GLenum result = glewInit();
+    if (result != GLEW_OK && result != GLEW_ERROR_NO_GLX_DISPLAY) {
+        std::cerr << "ERROR glewInit: " << glewGetErrorString(result) << std::endl;
+        destroy();
+        return false;
+    }
+    std::cout << "Headless renderer: " << glGetString(GL_RENDERER) << " (" << glGetString(GL_VERSION) << ")" << std::endl;
+
+    glGenRenderbuffers(2, rboId_);
+    glBindRenderbuffer(GL_RENDERBUFFER, rboId_[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width_, height_);
+    glBindRenderbuffer(GL_RENDERBUFFER, rboId_[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width_, height_);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &fboId_);
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rboId_[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboId_[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Offscreen framebuffer is incomplete" << std::endl;
+        destroy();
+        return false;
+    }
+
+    // Same fixed state mgl::Engine sets up for a window.
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
+    glDepthMask(GL_TRUE);
+    glDepthRange(0.0, 1.0);
+    glClearDepth(1.0);
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glFrontFace(GL_CCW);
+    glViewport(0, 0, width_, height_);
+    return true;
+}
+
+void HeadlessContext::destroy() {
+    if (!window_) return;
+    if (fboId_) glDeleteFramebuffers(1, &fboId_);
+    if (rboId_[0]) glDeleteRenderbuffers(2, rboId_);
+    fboId_ = 0;
+    rboId_[0] = rboId_[1] = 0;
+    glfwDestroyWindow(window_);
+    glfwTerminate();
+    window_ = nullptr;
+}
+
+void HeadlessContext::beginFrame() {
+    glBindFramebuffer(GL_FRAMEBUFFER, fboId_);
+    glViewport(0, 0, width_, height_);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+uint64_t HeadlessContext::checksum() {
+    pixels_.resize((size_t)width_ * height_ * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fboId_);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width_, height_, GL_RGBA, GL_UNSIGNED_BYTE, pixels_.data());
+
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : pixels_) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
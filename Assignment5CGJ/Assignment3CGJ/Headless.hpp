@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// Offscreen GL context for benchmarks and regression runs: a hidden GLFW
+// window, or, where no display is available, GLFW's null platform with an
+// OSMesa context (Mesa software rendering). Frames are rendered into a
+// fixed-size framebuffer object so results do not depend on a window.
+class HeadlessContext {
+public:
+    ~HeadlessContext();
+
+    bool create(int width, int height, int glMajor, int glMinor);
+    void destroy();
+
+    GLFWwindow* window() const { return window_; }
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Binds and clears the offscreen framebuffer.
+    void beginFrame();
+
+    // FNV-1a hash of the RGBA pixels of the last frame.
+    uint64_t checksum();
+
+private:
+    GLFWwindow* window_ = nullptr;
+    GLuint fboId_ = 0;
+    GLuint rboId_[2] = { 0, 0 };
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<unsigned char> pixels_;
+
+    bool openWindow(bool software, int glMajor, int glMinor);
+};
@@ -0,0 +1,57 @@
+#include "HeapStats.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocationCount{ 0 };
+std::atomic<uint64_t> freeCount{ 0 };
+std::atomic<uint64_t> byteCount{ 0 };
+
+void* allocate(std::size_t size) {
+    void* p = std::malloc(size ? size : 1);
+    if (p) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        byteCount.fetch_add(size, std::memory_order_relaxed);
+    }
+    return p;
+}
+
+void release(void* p) {
+    if (!p) return;
+    freeCount.fetch_add(1, std::memory_order_relaxed);
+    std::free(p);
+}
+
+}
+
+namespace HeapStats {
+
+uint64_t allocations() { return allocationCount.load(std::memory_order_relaxed); }
+uint64_t frees() { return freeCount.load(std::memory_order_relaxed); }
+uint64_t bytesAllocated() { return byteCount.load(std::memory_order_relaxed); }
+
+}
+
+void* operator new(std::size_t size) {
+    void* p = allocate(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size) {
+    void* p = allocate(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, std::size_t) noexcept { release(p); }
+void operator delete[](void* p, std::size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+
+// Counts every allocation made through the global operator new and delete
+// (HeapStats.cpp replaces them), so a frame can be checked for heap traffic:
+// take allocations() before and after and compare. Allocations made with
+// malloc directly, or by other modules (e.g. a DLL with its own heap), are
+// not seen.
+namespace HeapStats {
+
+uint64_t allocations();
+uint64_t frees();
+uint64_t bytesAllocated();
+
+// Allocations not freed yet.
+inline int64_t live() { return (int64_t)(allocations() - frees()); }
+
+}
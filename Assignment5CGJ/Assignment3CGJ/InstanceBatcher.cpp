@@ -0,0 +1,98 @@
+#include "InstanceBatcher.hpp"
+#include <algorithm>
+#include <cstddef>
+
+void InstanceBatcher::addVariant(mgl::ShaderProgram* shader, mgl::ShaderProgram* instanced) {
+    if (variantOf(shader)) return;
+    variants_.push_back({ shader, instanced });
+}
+
+mgl::ShaderProgram* InstanceBatcher::variantOf(mgl::ShaderProgram* shader) const {
+    for (const Variant& v : variants_) {
+        if (v.shader == shader) return v.instanced;
+    }
+    return nullptr;
+}
+
+void InstanceBatcher::add(const MeshBuffers* mesh, unsigned level, mgl::ShaderProgram* shader,
+    const glm::mat4& world, const glm::mat3& normal, const glm::vec4& color) {
+    for (Batch& b : batches_) {
+        if (b.mesh == mesh && b.level == level && b.shader == shader) {
+            b.instances.push_back({ world, color, normal });
+            return;
+        }
+    }
+    batches_.push_back({ mesh, level, shader, { { world, color, normal } } });
+}
+
+void InstanceBatcher::bindAttributes(GLuint buffer, size_t offset) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (GLuint column = 0; column < 4; column++) {
+        GLuint location = MODEL_MATRIX_ATTRIBUTE + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+            reinterpret_cast<GLvoid*>(offset + offsetof(Instance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location, 1);
+    }
+    glEnableVertexAttribArray(COLOR_ATTRIBUTE);
+    glVertexAttribPointer(COLOR_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+        reinterpret_cast<GLvoid*>(offset + offsetof(Instance, color)));
+    glVertexAttribDivisor(COLOR_ATTRIBUTE, 1);
+    for (GLuint column = 0; column < 3; column++) {
+        GLuint location = NORMAL_MATRIX_ATTRIBUTE + column;
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(Instance),
+            reinterpret_cast<GLvoid*>(offset + offsetof(Instance, normal) + column * sizeof(glm::vec3)));
+        glVertexAttribDivisor(location, 1);
+    }
+}
+
+// Every batch's instances, back to back in this frame's stream region.
+size_t InstanceBatcher::upload() {
+    size_t count = 0;
+    for (const Batch& b : batches_) count += b.instances.size();
+    Instance* out = static_cast<Instance*>(stream_.begin(count * sizeof(Instance)));
+    for (const Batch& b : batches_) out = std::copy(b.instances.begin(), b.instances.end(), out);
+    return stream_.end();
+}
+
+void InstanceBatcher::flush() {
+    drawCalls_ = 0;
+    instanceCount_ = 0;
+    triangleCount_ = 0;
+    // Batches stay allocated from frame to frame; one that got no instance
+    // since the last flush (its mesh went out of view, or was freed) goes.
+    batches_.erase(std::remove_if(batches_.begin(), batches_.end(),
+        [](const Batch& b) { return b.instances.empty(); }), batches_.end());
+    if (batches_.empty()) return;
+    size_t offset = upload();
+
+    mgl::ShaderProgram* bound = nullptr;
+    size_t first = 0;
+    for (Batch& b : batches_) {
+        mgl::ShaderProgram* program = variantOf(b.shader);
+        if (!program) {
+            first += b.instances.size();
+            b.instances.clear();
+            continue;
+        }
+        if (program != bound) {
+            bound = program;
+            bound->bind();
+        }
+
+        b.mesh->bindVertexArray();
+        bindAttributes(stream_.buffer(), offset + first * sizeof(Instance));
+
+        b.mesh->drawElementsInstanced((GLsizei)b.instances.size(), 0, b.level);
+        drawCalls_++;
+        instanceCount_ += (int)b.instances.size();
+        triangleCount_ += (int)b.instances.size() * (b.mesh->indexCount(b.level) / 3);
+
+        first += b.instances.size();
+        b.instances.clear();
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stream_.fence();
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <vector>
+#include "../mgl/mgl.hpp"
+#include "DrawSink.hpp"
+#include "MeshBuffers.hpp"
+#include "StreamBuffer.hpp"
+
+// Collects draws during scene traversal, groups them by (mesh, level of
+// detail, shader) and issues each group as a single instanced draw.
+// Per-instance matrices and colours are written straight into a
+// persistently mapped StreamBuffer.
+class InstanceBatcher : public IDrawSink {
+public:
+    // Locations read by a5-instanced-vs.glsl; the matrices take 4 and 3 slots.
+    static const GLuint MODEL_MATRIX_ATTRIBUTE = 5;
+    static const GLuint COLOR_ATTRIBUTE = 9;
+    static const GLuint NORMAL_MATRIX_ATTRIBUTE = 10;
+
+    // Instanced program used in place of `shader` when its batches are drawn.
+    // A shader that already has one keeps it.
+    void addVariant(mgl::ShaderProgram* shader, mgl::ShaderProgram* instanced);
+
+    void add(const MeshBuffers* mesh, unsigned level, mgl::ShaderProgram* shader, const glm::mat4& world,
+        const glm::mat3& normal, const glm::vec4& color) override;
+    void flush();
+
+    // Draw calls, instances and triangles issued by the last flush().
+    int drawCalls() const { return drawCalls_; }
+    int instanceCount() const { return instanceCount_; }
+    int triangleCount() const { return triangleCount_; }
+
+    // Per-instance vertex data, as read by a5-instanced-vs.glsl.
+    struct Instance {
+        glm::mat4 model;
+        glm::vec4 color;
+        glm::mat3 normal;
+    };
+
+    // Points the instance attributes of the bound VAO at Instance records
+    // starting at `offset` in `buffer`.
+    static void bindAttributes(GLuint buffer, size_t offset);
+
+private:
+    struct Batch {
+        const MeshBuffers* mesh;
+        unsigned level;
+        mgl::ShaderProgram* shader;
+        std::vector<Instance> instances;
+    };
+
+    struct Variant {
+        mgl::ShaderProgram* shader;
+        mgl::ShaderProgram* instanced;
+    };
+
+    std::vector<Batch> batches_;
+    std::vector<Variant> variants_;
+    StreamBuffer stream_;
+    int drawCalls_ = 0;
+    int instanceCount_ = 0;
+    int triangleCount_ = 0;
+
+    mgl::ShaderProgram* variantOf(mgl::ShaderProgram* shader) const;
+    size_t upload();
+};
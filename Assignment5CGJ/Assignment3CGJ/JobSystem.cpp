@@ -0,0 +1,98 @@
+#include "JobSystem.hpp"
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned threads) {
+    if (threads == 0) {
+        unsigned hw = std::thread::hardware_concurrency();
+        threads = std::max(1u, hw > 1 ? hw - 1 : 1u);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        queues_.emplace_back(new Queue());
+    }
+    for (unsigned i = 1; i < threads; i++) {
+        workers_.emplace_back(&JobSystem::work, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& t : workers_) t.join();
+}
+
+void JobSystem::run(size_t count, size_t grain, Thunk thunk, const void* function) {
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    if (workers_.empty() || count <= grain) {
+        thunk(function, 0, count, 0);
+        return;
+    }
+
+    size_t chunks = (count + grain - 1) / grain;
+    remaining_ = chunks;
+    {
+        // Counted before any chunk is visible, so a worker still looking
+        // for work cannot take one and decrement below zero; under the
+        // lock, so a worker about to sleep cannot miss the work.
+        std::lock_guard<std::mutex> lock(mutex_);
+        queued_ += chunks;
+    }
+    for (size_t c = 0; c < chunks; c++) {
+        size_t begin = c * grain;
+        Queue& queue = *queues_[c % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.chunks.push_back({ thunk, function, begin, std::min(begin + grain, count) });
+    }
+    wake_.notify_all();
+
+    while (remaining_ > 0) {
+        if (runOne(0)) continue;
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return remaining_ == 0; });
+    }
+}
+
+bool JobSystem::runOne(unsigned thread) {
+    Chunk chunk;
+    bool found = false;
+    size_t n = queues_.size();
+    for (size_t k = 0; k < n && !found; k++) {
+        Queue& queue = *queues_[(thread + k) % n];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.head == queue.chunks.size()) continue;
+        if (k == 0) {
+            chunk = queue.chunks[queue.head++];
+        }
+        else {
+            chunk = queue.chunks.back();
+            queue.chunks.pop_back();
+            stolen_++;
+        }
+        if (queue.head == queue.chunks.size()) {
+            queue.chunks.clear();
+            queue.head = 0;
+        }
+        found = true;
+    }
+    if (!found) return false;
+    queued_--;
+
+    chunk.thunk(chunk.function, chunk.begin, chunk.end, thread);
+    if (--remaining_ == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.notify_all();
+    }
+    return true;
+}
+
+void JobSystem::work(unsigned thread) {
+    for (;;) {
+        if (runOne(thread)) continue;
+        std::unique_lock<std::mutex> lock(mutex_);
+        wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (stop_) return;
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs data-parallel loops on a fixed pool of threads. parallelFor() cuts
+// the range into chunks and deals them round-robin into one queue per
+// thread; every thread takes work from the front of its own queue and, once
+// that is empty, steals from the back of the others'. The calling thread
+// takes part as thread 0 and returns when every chunk has run.
+//
+// Only one thread may call parallelFor() at a time, and not from inside a
+// chunk. Once the queues have grown to a frame's worth of chunks, a call
+// makes no heap allocations.
+class JobSystem {
+public:
+
+    // 0 threads picks one less than the hardware concurrency; with 1 every
+    // chunk runs on the caller.
+    explicit JobSystem(unsigned threads = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Threads that run chunks, the caller included.
+    unsigned threadCount() const { return (unsigned)queues_.size(); }
+
+    // Calls function(begin, end, thread) for chunks [begin, end) of at most
+    // `grain` items, `thread` being the index of the thread running it.
+    template <typename Function>
+    void parallelFor(size_t count, size_t grain, const Function& function) {
+        run(count, grain, [](const void* f, size_t begin, size_t end, unsigned thread) {
+            (*static_cast<const Function*>(f))(begin, end, thread);
+        }, &function);
+    }
+
+    // Chunks run by a thread other than the one they were dealt to, since
+    // the last resetStats().
+    int stolenCount() const { return stolen_; }
+    void resetStats() { stolen_ = 0; }
+
+private:
+    typedef void (*Thunk)(const void* function, size_t begin, size_t end, unsigned thread);
+
+    struct Chunk {
+        Thunk thunk;
+        const void* function;
+        size_t begin;
+        size_t end;
+    };
+
+    // Owner takes from `head`, thieves from the back; emptied, it starts
+    // over at the front of its storage.
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Chunk> chunks;
+        size_t head = 0;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues_;   // [0] belongs to the caller
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::atomic<size_t> queued_{ 0 };
+    std::atomic<size_t> remaining_{ 0 };
+    std::atomic<int> stolen_{ 0 };
+    bool stop_ = false;
+
+    void run(size_t count, size_t grain, Thunk thunk, const void* function);
+    bool runOne(unsigned thread);
+    void work(unsigned thread);
+};
@@ -0,0 +1,144 @@
+#include "LightGrid.hpp"
+#include <algorithm>
+#include <cmath>
+
+LightGrid::~LightGrid() {
+    if (textureId_[0]) glDeleteTextures(3, textureId_);
+    if (bufferId_[0]) glDeleteBuffers(3, bufferId_);
+}
+
+// Screen rectangle of the light's view-space bounding box, in tiles. Lights
+// entirely behind the camera or off screen are rejected; a box that
+// crosses the camera plane covers the whole screen.
+bool LightGrid::tileRect(const PointLight& light, const glm::mat4& view, const glm::mat4& projection, int width,
+    int height, int tileSize, glm::ivec4& rect) const {
+    glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+    float r = light.radius;
+    if (center.z - r > 0.0f) return false;
+
+    glm::vec2 lo(1.0f), hi(-1.0f);
+    bool crossesCamera = false;
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner = center + glm::vec3(i & 1 ? r : -r, i & 2 ? r : -r, i & 4 ? r : -r);
+        glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+        if (clip.w <= 1e-5f) {
+            crossesCamera = true;
+            break;
+        }
+        glm::vec2 ndc(clip.x / clip.w, clip.y / clip.w);
+        lo = glm::min(lo, ndc);
+        hi = glm::max(hi, ndc);
+    }
+    if (crossesCamera) {
+        lo = glm::vec2(-1.0f);
+        hi = glm::vec2(1.0f);
+    }
+    if (lo.x > 1.0f || lo.y > 1.0f || hi.x < -1.0f || hi.y < -1.0f) return false;
+
+    auto toTile = [tileSize](float ndc, int pixels, int tiles) {
+        int t = (int)std::floor((ndc * 0.5f + 0.5f) * pixels / tileSize);
+        return std::min(std::max(t, 0), tiles - 1);
+    };
+    rect = glm::ivec4(toTile(lo.x, width, tilesX_), toTile(lo.y, height, tilesY_),
+        toTile(hi.x, width, tilesX_), toTile(hi.y, height, tilesY_));
+    return true;
+}
+
+void LightGrid::build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+    int width, int height) {
+    width = std::max(width, 1);
+    height = std::max(height, 1);
+    int tileSize = tileSize_ > 0 ? tileSize_ : std::max(width, height);
+    builtTileSize_ = tileSize;
+    tilesX_ = (width + tileSize - 1) / tileSize;
+    tilesY_ = (height + tileSize - 1) / tileSize;
+    size_t tileCount = (size_t)tilesX_ * tilesY_;
+
+    lightCount_ = (int)lights.size();
+    lights_.clear();
+    rects_.clear();
+    visible_.clear();
+    for (const PointLight& light : lights) {
+        glm::ivec4 rect;
+        if (!tileRect(light, view, projection, width, height, tileSize, rect)) continue;
+        visible_.push_back((GLuint)(lights_.size() / 2));
+        rects_.push_back(rect);
+        lights_.push_back(glm::vec4(light.position, light.radius));
+        lights_.push_back(glm::vec4(light.color, light.intensity));
+    }
+    visibleCount_ = (int)visible_.size();
+
+    // Count, prefix sum, fill: every tile's indices end up contiguous.
+    tiles_.assign(tileCount * 2, 0);
+    for (const glm::ivec4& r : rects_) {
+        for (int y = r.y; y <= r.w; y++) {
+            for (int x = r.x; x <= r.z; x++) tiles_[2 * (y * tilesX_ + x) + 1]++;
+        }
+    }
+    GLuint total = 0;
+    maxPerTile_ = 0;
+    for (size_t t = 0; t < tileCount; t++) {
+        tiles_[2 * t] = total;
+        total += tiles_[2 * t + 1];
+        maxPerTile_ = std::max(maxPerTile_, (int)tiles_[2 * t + 1]);
+        tiles_[2 * t + 1] = 0;
+    }
+    indices_.resize(total);
+    for (size_t i = 0; i < rects_.size(); i++) {
+        const glm::ivec4& r = rects_[i];
+        for (int y = r.y; y <= r.w; y++) {
+            for (int x = r.x; x <= r.z; x++) {
+                GLuint* tile = &tiles_[2 * (y * tilesX_ + x)];
+                indices_[tile[0] + tile[1]++] = visible_[i];
+            }
+        }
+    }
+}
+
+void LightGrid::upload() {
+    if (!bufferId_[0]) {
+        glGenBuffers(3, bufferId_);
+        glGenTextures(3, textureId_);
+    }
+    const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+    const void* data[3] = { lights_.data(), tiles_.data(), indices_.data() };
+    size_t bytes[3] = { lights_.size() * sizeof(glm::vec4), tiles_.size() * sizeof(GLuint),
+        indices_.size() * sizeof(GLuint) };
+    for (int i = 0; i < 3; i++) {
+        // Orphan last frame's storage; never allocate zero bytes.
+        glBindBuffer(GL_TEXTURE_BUFFER, bufferId_[i]);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(bytes[i], (size_t)16), nullptr, GL_STREAM_DRAW);
+        if (bytes[i]) glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes[i], data[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, textureId_[i]);
+        glTexBuffer(GL_TEXTURE_BUFFER, formats[i], bufferId_[i]);
+    }
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+LightGrid::Locations LightGrid::locate(mgl::ShaderProgram* program) {
+    const char* samplers[3] = { "uLights", "uLightTiles", "uLightIndices" };
+    Locations locations;
+    for (int i = 0; i < 3; i++) {
+        if (program->isUniform(samplers[i])) locations.samplers[i] = program->Uniforms[samplers[i]].index;
+    }
+    if (program->isUniform("uTileSize")) locations.tileSize = program->Uniforms["uTileSize"].index;
+    if (program->isUniform("uTilesX")) locations.tilesX = program->Uniforms["uTilesX"].index;
+    return locations;
+}
+
+void LightGrid::bind(mgl::ShaderProgram* program, const Locations& locations) const {
+    const GLint units[3] = { LIGHTS_UNIT, TILES_UNIT, INDICES_UNIT };
+    for (int i = 0; i < 3; i++) {
+        glActiveTexture(GL_TEXTURE0 + units[i]);
+        glBindTexture(GL_TEXTURE_BUFFER, textureId_[i]);
+    }
+    glActiveTexture(GL_TEXTURE0);
+
+    program->bind();
+    for (int i = 0; i < 3; i++) {
+        if (locations.samplers[i] >= 0) glUniform1i(locations.samplers[i], units[i]);
+    }
+    if (locations.tileSize >= 0) glUniform1i(locations.tileSize, builtTileSize_);
+    if (locations.tilesX >= 0) glUniform1i(locations.tilesX, tilesX_);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include "../mgl/mgl.hpp"
+
+struct PointLight {
+    glm::vec3 position;
+    float radius;           // no contribution beyond this distance
+    glm::vec3 color;
+    float intensity;
+};
+
+// Tiled forward ("forward+") light lists. build() projects every light's
+// bounding sphere to the screen and bins it into the TILE_SIZE tiles it
+// covers; upload() stores the lights, each tile's (first, count) range and
+// the concatenated per-tile light indices in texture buffers, which
+// a5-fs.glsl reads when TILED_LIGHTS is defined. A fragment only visits the
+// lights of its own tile.
+class LightGrid {
+public:
+    static const int TILE_SIZE = 16;
+
+    // Texture units of the uLights, uLightTiles and uLightIndices samplers.
+    static const GLint LIGHTS_UNIT = 1;
+    static const GLint TILES_UNIT = 2;
+    static const GLint INDICES_UNIT = 3;
+
+    ~LightGrid();
+
+    // A tile size of 0 uses one tile for the whole viewport, i.e. every
+    // fragment loops over every visible light (for comparisons).
+    void setTileSize(int pixels) { tileSize_ = pixels; }
+    int tileSize() const { return tileSize_; }
+
+    void build(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection,
+        int width, int height);
+    void upload();
+
+    // Where a program keeps the grid uniforms; -1 for those it lacks.
+    struct Locations {
+        GLint samplers[3] = { -1, -1, -1 };     // uLights, uLightTiles, uLightIndices
+        GLint tileSize = -1;
+        GLint tilesX = -1;
+    };
+    static Locations locate(mgl::ShaderProgram* program);
+
+    // Binds the buffers to their units and sets the grid uniforms.
+    void bind(mgl::ShaderProgram* program, const Locations& locations) const;
+
+    // Results of the last build().
+    int lightCount() const { return lightCount_; }
+    int visibleCount() const { return visibleCount_; }
+    int maxPerTile() const { return maxPerTile_; }
+    float averagePerTile() const { return tiles_.empty() ? 0.0f : (float)indices_.size() / (tiles_.size() / 2); }
+
+private:
+    int tileSize_ = TILE_SIZE;
+    int builtTileSize_ = TILE_SIZE;
+    int tilesX_ = 0;
+    int tilesY_ = 0;
+    int lightCount_ = 0;
+    int visibleCount_ = 0;
+    int maxPerTile_ = 0;
+
+    std::vector<glm::vec4> lights_;     // (position, radius), (colour, intensity)
+    std::vector<GLuint> tiles_;         // (first, count) per tile, row by row
+    std::vector<GLuint> indices_;
+    std::vector<glm::ivec4> rects_;     // tile rectangle of each visible light
+    std::vector<GLuint> visible_;
+
+    GLuint bufferId_[3] = { 0, 0, 0 };
+    GLuint textureId_[3] = { 0, 0, 0 };
+
+    bool tileRect(const PointLight& light, const glm::mat4& view, const glm::mat4& projection, int width,
+        int height, int tileSize, glm::ivec4& rect) const;
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file (Win32 or POSIX).
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    void close();
+
+    // Renames `from` over `to` in one step, so readers see either the old
+    // file or the new one; mappings of the old file keep its contents.
+    static bool replace(const std::string& from, const std::string& to);
+
+    const unsigned char* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool isOpen() const { return data_ != nullptr; }
+
+private:
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+    const unsigned char* data_ = nullptr;
+    size_t size_ = 0;
+};
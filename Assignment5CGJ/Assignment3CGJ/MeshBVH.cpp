@@ -0,0 +1,204 @@
+#include "MeshBVH.hpp"
+
+void MeshBVH::build(const MeshGeometry& geometry) {
+    build(geometry.positions.data(), sizeof(glm::vec3), geometry.indices.data(), geometry.indices.size());
+}
+
+void MeshBVH::build(const glm::vec3* positions, size_t stride, const unsigned int* indices, size_t indexCount) {
+    nodes_.clear();
+    triangles_.clear();
+
+    uint32_t triCount = (uint32_t)(indexCount / 3);
+    if (triCount == 0) return;
+
+    const unsigned char* base = reinterpret_cast<const unsigned char*>(positions);
+    auto vertex = [&](uint32_t tri, int corner) -> const glm::vec3& {
+        return *reinterpret_cast<const glm::vec3*>(base + indices[3 * tri + corner] * stride);
+    };
+
+    std::vector<AABB> boxes(triCount);
+    std::vector<glm::vec3> centroids(triCount);
+    std::vector<uint32_t> order(triCount);
+    for (uint32_t i = 0; i < triCount; i++) {
+        const glm::vec3& a = vertex(i, 0);
+        const glm::vec3& b = vertex(i, 1);
+        const glm::vec3& c = vertex(i, 2);
+        boxes[i].expand(a);
+        boxes[i].expand(b);
+        boxes[i].expand(c);
+        centroids[i] = (a + b + c) / 3.0f;
+        order[i] = i;
+    }
+
+    nodes_.reserve(2 * triCount / MAX_LEAF_TRIANGLES + 1);
+    buildNode(order, boxes, centroids, 0, triCount, 0);
+
+    // Store triangles in leaf order so a leaf reads one contiguous range.
+    triangles_.resize(triCount);
+    for (uint32_t i = 0; i < triCount; i++) {
+        uint32_t t = order[i];
+        const glm::vec3& a = vertex(t, 0);
+        const glm::vec3& b = vertex(t, 1);
+        const glm::vec3& c = vertex(t, 2);
+        triangles_[i] = { a, b - a, c - a };
+    }
+}
+
+uint32_t MeshBVH::buildNode(std::vector<uint32_t>& order, const std::vector<AABB>& boxes,
+    const std::vector<glm::vec3>& centroids, uint32_t start, uint32_t count, uint32_t depth) {
+    uint32_t index = (uint32_t)nodes_.size();
+    nodes_.push_back(Node());
+
+    AABB box, centroidBox;
+    for (uint32_t i = start; i < start + count; i++) {
+        box.expand(boxes[order[i]]);
+        centroidBox.expand(centroids[order[i]]);
+    }
+    nodes_[index].box = box;
+
+    if (count <= MAX_LEAF_TRIANGLES) {
+        nodes_[index].start = start;
+        nodes_[index].count = count;
+        return index;
+    }
+
+    // Binned SAH along the widest centroid axis, or the median past
+    // MAX_SAH_DEPTH.
+    glm::vec3 extent = centroidBox.extent();
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+
+    uint32_t mid = start + count / 2;
+    if (extent[axis] > 0.0f && depth >= MAX_SAH_DEPTH) {
+        std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + start + count,
+            [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+    }
+    else if (extent[axis] > 0.0f) {
+        AABB binBox[SAH_BINS];
+        uint32_t binCount[SAH_BINS] = {};
+        float scale = SAH_BINS / extent[axis];
+        auto binOf = [&](uint32_t tri) {
+            int b = (int)((centroids[tri][axis] - centroidBox.min[axis]) * scale);
+            return std::min(b, SAH_BINS - 1);
+        };
+        for (uint32_t i = start; i < start + count; i++) {
+            int b = binOf(order[i]);
+            binBox[b].expand(boxes[order[i]]);
+            binCount[b]++;
+        }
+
+        float leftArea[SAH_BINS - 1], rightArea[SAH_BINS - 1];
+        uint32_t leftCount[SAH_BINS - 1], rightCount[SAH_BINS - 1];
+        AABB acc;
+        uint32_t n = 0;
+        for (int i = 0; i < SAH_BINS - 1; i++) {
+            acc.expand(binBox[i]);
+            n += binCount[i];
+            leftArea[i] = acc.surfaceArea();
+            leftCount[i] = n;
+        }
+        acc = AABB();
+        n = 0;
+        for (int i = SAH_BINS - 1; i > 0; i--) {
+            acc.expand(binBox[i]);
+            n += binCount[i];
+            rightArea[i - 1] = acc.surfaceArea();
+            rightCount[i - 1] = n;
+        }
+
+        int bestSplit = -1;
+        float bestCost = box.surfaceArea() * count;
+        for (int i = 0; i < SAH_BINS - 1; i++) {
+            if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+            float cost = leftArea[i] * leftCount[i] + rightArea[i] * rightCount[i];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        if (bestSplit >= 0) {
+            uint32_t* first = order.data() + start;
+            uint32_t* last = first + count;
+            uint32_t* pivot = std::partition(first, last, [&](uint32_t tri) { return binOf(tri) <= bestSplit; });
+            mid = (uint32_t)(pivot - order.data());
+        }
+        else {
+            std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + start + count,
+                [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+        }
+    }
+
+    buildNode(order, boxes, centroids, start, mid - start, depth + 1);
+    uint32_t right = buildNode(order, boxes, centroids, mid, start + count - mid, depth + 1);
+    nodes_[index].right = right;
+    return index;
+}
+
+bool MeshBVH::intersectTriangle(const Ray& ray, const Triangle& tri, float& t) {
+    // Moller-Trumbore, two-sided so picking works on open meshes.
+    glm::vec3 p = glm::cross(ray.direction, tri.e2);
+    float det = glm::dot(tri.e1, p);
+    if (glm::abs(det) < 1e-12f) return false;
+    float invDet = 1.0f / det;
+
+    glm::vec3 s = ray.origin - tri.v0;
+    float u = glm::dot(s, p) * invDet;
+    if (u < 0.0f || u > 1.0f) return false;
+
+    glm::vec3 q = glm::cross(s, tri.e1);
+    float v = glm::dot(ray.direction, q) * invDet;
+    if (v < 0.0f || u + v > 1.0f) return false;
+
+    float d = glm::dot(tri.e2, q) * invDet;
+    if (d <= 0.0f || d >= t) return false;
+    t = d;
+    return true;
+}
+
+bool MeshBVH::intersect(const Ray& ray, float& tHit) const {
+    if (nodes_.empty()) return false;
+
+    bool hit = false;
+    uint32_t stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const Node& node = nodes_[stack[--top]];
+        float tNode;
+        if (!ray.intersects(node.box, tHit, tNode)) continue;
+
+        if (node.count > 0) {
+            for (uint32_t i = node.start; i < node.start + node.count; i++) {
+                if (intersectTriangle(ray, triangles_[i], tHit)) hit = true;
+            }
+            continue;
+        }
+
+        // Push the farther child first so the nearer one is visited next.
+        uint32_t left = (uint32_t)(&node - nodes_.data()) + 1;
+        uint32_t right = node.right;
+        float tLeft, tRight;
+        bool hitLeft = ray.intersects(nodes_[left].box, tHit, tLeft);
+        bool hitRight = ray.intersects(nodes_[right].box, tHit, tRight);
+        if (hitLeft && hitRight) {
+            if (tLeft < tRight) std::swap(left, right);
+            stack[top++] = left;
+            stack[top++] = right;
+        }
+        else if (hitLeft) {
+            stack[top++] = left;
+        }
+        else if (hitRight) {
+            stack[top++] = right;
+        }
+    }
+    return hit;
+}
+
+const AABB& MeshBVH::bounds() const {
+    static const AABB emptyBox;
+    return nodes_.empty() ? emptyBox : nodes_[0].box;
+}
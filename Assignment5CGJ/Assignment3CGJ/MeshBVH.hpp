@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Bounds.hpp"
+#include "MeshGeometry.hpp"
+
+// Bounding volume hierarchy over the triangles of one mesh, in mesh space.
+// Built once per mesh (binned SAH) and shared by every node that draws it.
+class MeshBVH {
+public:
+    void build(const MeshGeometry& geometry);
+
+    // Positions may be interleaved; stride is the byte distance between them.
+    void build(const glm::vec3* positions, size_t stride, const unsigned int* indices, size_t indexCount);
+
+    // Nearest hit closer than tHit; on success tHit is updated.
+    bool intersect(const Ray& ray, float& tHit) const;
+
+    const AABB& bounds() const;
+    bool empty() const { return nodes_.empty(); }
+    size_t nodeCount() const { return nodes_.size(); }
+
+private:
+    static const uint32_t MAX_LEAF_TRIANGLES = 4;
+    static const int SAH_BINS = 12;
+    // Below this depth nodes split at the object median, which halves the
+    // triangle count, so no tree is deeper than MAX_SAH_DEPTH + 30 and
+    // intersect() never holds more than that plus one entries on its stack.
+    static const uint32_t MAX_SAH_DEPTH = 32;
+    static const int STACK_SIZE = 64;
+
+    // Leaves have count > 0; an inner node's left child follows it directly.
+    struct Node {
+        AABB box;
+        uint32_t start = 0;
+        uint32_t count = 0;
+        uint32_t right = 0;
+    };
+
+    struct Triangle {
+        glm::vec3 v0, e1, e2;
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<Triangle> triangles_;
+
+    uint32_t buildNode(std::vector<uint32_t>& order, const std::vector<AABB>& boxes,
+        const std::vector<glm::vec3>& centroids, uint32_t start, uint32_t count, uint32_t depth);
+    static bool intersectTriangle(const Ray& ray, const Triangle& tri, float& t);
+};
@@ -0,0 +1,152 @@
+#include "MeshBuffers.hpp"
+#include "MeshOptimizer.hpp"
+#include "../mgl/mgl.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+MeshBuffers::~MeshBuffers() {
+    destroy();
+}
+
+void MeshBuffers::create(const MeshGeometry& geometry) {
+    std::vector<Vertex> vertices(geometry.vertexCount());
+    for (size_t i = 0; i < vertices.size(); i++) {
+        vertices[i].position = geometry.positions[i];
+        vertices[i].normal = geometry.normals[i];
+        vertices[i].texcoord = geometry.texcoords[i];
+        vertices[i].tangent = geometry.tangents[i];
+    }
+    create(vertices.data(), vertices.size(), geometry.indices.data(), geometry.indices.size());
+}
+
+void MeshBuffers::create(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+    const Lod* lods, size_t lodCount) {
+    create(vertices, FULL, vertexCount, indices, GL_UNSIGNED_INT, indexCount, lods, lodCount);
+}
+
+void MeshBuffers::create(const void* vertices, VertexFormat format, size_t vertexCount, const void* indices,
+    GLenum indexType, size_t indexCount, const Lod* lods, size_t lodCount) {
+    destroy();
+    indexType_ = indexType;
+    format_ = format;
+    if (lodCount > 0) lods_.assign(lods, lods + lodCount);
+    else lods_.push_back({ 0, (uint32_t)indexCount, 0.0f });
+
+    const Vertex* full = static_cast<const Vertex*>(vertices);
+    const PackedVertex* packed = static_cast<const PackedVertex*>(vertices);
+    std::vector<glm::vec3> positions(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        positions[i] = format == FULL ? full[i].position : MeshOptimizer::unpackPosition(packed[i]);
+        bounds_.expand(positions[i]);
+    }
+    if (!bounds_.isEmpty()) {
+        sphere_.center = bounds_.center();
+        sphere_.radius = 0.0f;
+        for (const glm::vec3& p : positions) {
+            sphere_.radius = std::max(sphere_.radius, glm::distance(sphere_.center, p));
+        }
+    }
+
+    size_t stride = format == FULL ? sizeof(Vertex) : sizeof(PackedVertex);
+    vertexBytes_ = vertexCount * stride;
+    indexBytes_ = indexCount * (indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+
+    glGenVertexArrays(1, &vaoId_);
+    glBindVertexArray(vaoId_);
+    {
+        glGenBuffers(2, vboId_);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vboId_[0]);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes_, vertices, GL_STATIC_DRAW);
+
+        if (format == FULL) {
+            glEnableVertexAttribArray(mgl::Mesh::POSITION);
+            glVertexAttribPointer(mgl::Mesh::POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                reinterpret_cast<GLvoid*>(offsetof(Vertex, position)));
+
+            glEnableVertexAttribArray(mgl::Mesh::NORMAL);
+            glVertexAttribPointer(mgl::Mesh::NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                reinterpret_cast<GLvoid*>(offsetof(Vertex, normal)));
+
+            glEnableVertexAttribArray(mgl::Mesh::TEXCOORD);
+            glVertexAttribPointer(mgl::Mesh::TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                reinterpret_cast<GLvoid*>(offsetof(Vertex, texcoord)));
+
+            glEnableVertexAttribArray(mgl::Mesh::TANGENT);
+            glVertexAttribPointer(mgl::Mesh::TANGENT, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                reinterpret_cast<GLvoid*>(offsetof(Vertex, tangent)));
+        }
+        else {
+            glEnableVertexAttribArray(mgl::Mesh::POSITION);
+            glVertexAttribPointer(mgl::Mesh::POSITION, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                reinterpret_cast<GLvoid*>(offsetof(PackedVertex, position)));
+
+            // mgl::Mesh::NORMAL stays disabled; bindVertexArray() makes it
+            // read as zero, which tells the shaders to use the octahedral
+            // normal instead.
+            glEnableVertexAttribArray(PACKED_NORMAL_ATTRIBUTE);
+            glVertexAttribPointer(PACKED_NORMAL_ATTRIBUTE, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                reinterpret_cast<GLvoid*>(offsetof(PackedVertex, normal)));
+
+            glEnableVertexAttribArray(mgl::Mesh::TEXCOORD);
+            glVertexAttribPointer(mgl::Mesh::TEXCOORD, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex),
+                reinterpret_cast<GLvoid*>(offsetof(PackedVertex, texcoord)));
+
+            glEnableVertexAttribArray(mgl::Mesh::TANGENT);
+            glVertexAttribPointer(mgl::Mesh::TANGENT, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                reinterpret_cast<GLvoid*>(offsetof(PackedVertex, tangent)));
+        }
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboId_[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes_, indices, GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void MeshBuffers::destroy() {
+    if (vaoId_ == 0) return;
+    glDeleteVertexArrays(1, &vaoId_);
+    glDeleteBuffers(2, vboId_);
+    vaoId_ = 0;
+    vboId_[0] = vboId_[1] = 0;
+    lods_.clear();
+    vertexBytes_ = indexBytes_ = 0;
+    bounds_ = AABB();
+    sphere_ = Sphere();
+}
+
+void MeshBuffers::bindVertexArray() const {
+    glBindVertexArray(vaoId_);
+    if (format_ == PACKED) glVertexAttrib3f(mgl::Mesh::NORMAL, 0.0f, 0.0f, 0.0f);
+}
+
+void MeshBuffers::draw() const {
+    bindVertexArray();
+    drawElements();
+    glBindVertexArray(0);
+}
+
+static const GLvoid* indexOffset(GLenum indexType, uint32_t firstIndex) {
+    size_t size = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    return reinterpret_cast<const GLvoid*>((size_t)firstIndex * size);
+}
+
+void MeshBuffers::drawElements(unsigned level) const {
+    const Lod& l = lods_[level];
+    glDrawElements(GL_TRIANGLES, l.indexCount, indexType_, indexOffset(indexType_, l.firstIndex));
+}
+
+void MeshBuffers::drawElementsInstanced(GLsizei instances, GLuint baseInstance, unsigned level) const {
+    const Lod& l = lods_[level];
+    glDrawElementsInstancedBaseInstance(GL_TRIANGLES, l.indexCount, indexType_, indexOffset(indexType_, l.firstIndex),
+        instances, baseInstance);
+}
+
+void MeshBuffers::drawInstanced(GLsizei instances) const {
+    bindVertexArray();
+    glDrawElementsInstanced(GL_TRIANGLES, lods_[0].indexCount, indexType_, 0, instances);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <GL/glew.h>
+#include <vector>
+#include "Bounds.hpp"
+#include "MeshGeometry.hpp"
+
+// GPU copy of a MeshGeometry: one VAO with an interleaved vertex buffer and
+// a 16- or 32-bit index buffer. Attribute locations follow mgl::Mesh, so the
+// same shaders work with both. Unlike mgl::Mesh it exposes the counts needed
+// for instanced draws.
+//
+// Vertices are either full floats (Vertex) or quantized (PackedVertex, see
+// MeshOptimizer): half-float positions, octahedral normals and tangents in
+// normalized shorts, and normalized unsigned short texture coordinates.
+// Packed normals go to PACKED_NORMAL_ATTRIBUTE and the shaders decode them.
+//
+// The index buffer may hold several levels of detail back to back, all
+// indexing the same vertices; level 0 is the full mesh.
+class MeshBuffers {
+public:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+        glm::vec2 texcoord;
+        glm::vec3 tangent;
+    };
+
+    struct PackedVertex {
+        uint16_t position[4];   // half floats, w = 1
+        int16_t normal[2];      // octahedral
+        int16_t tangent[2];     // octahedral
+        uint16_t texcoord[2];   // [0, 1]
+    };
+
+    enum VertexFormat { FULL, PACKED };
+
+    static const GLuint PACKED_NORMAL_ATTRIBUTE = 13;
+
+    // Index range of one level, and how far (mesh units) its surface may
+    // stray from level 0.
+    struct Lod {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error;
+    };
+
+    ~MeshBuffers();
+
+    void create(const MeshGeometry& geometry);
+    // Without a level table the whole index buffer is level 0.
+    void create(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+        const Lod* lods = nullptr, size_t lodCount = 0);
+    // `indexType` is GL_UNSIGNED_SHORT or GL_UNSIGNED_INT.
+    void create(const void* vertices, VertexFormat format, size_t vertexCount, const void* indices, GLenum indexType,
+        size_t indexCount, const Lod* lods = nullptr, size_t lodCount = 0);
+    void destroy();
+
+    void draw() const;
+    void drawInstanced(GLsizei instances) const;
+
+    // Binds vao(). For PACKED meshes it also sets the constant value of the
+    // disabled mgl::Mesh::NORMAL to zero: that value is context state, not
+    // VAO state, and the shaders read zero as "use the octahedral normal".
+    void bindVertexArray() const;
+
+    // Like draw() and drawInstanced(), for callers that already called
+    // bindVertexArray() and keep the VAO bound. Instance attributes start at record baseInstance.
+    void drawElements(unsigned level = 0) const;
+    void drawElementsInstanced(GLsizei instances, GLuint baseInstance = 0, unsigned level = 0) const;
+
+    // False until create() has uploaded the buffers.
+    bool ready() const { return vaoId_ != 0; }
+    GLuint vao() const { return vaoId_; }
+    GLsizei indexCount(unsigned level = 0) const { return level < lods_.size() ? (GLsizei)lods_[level].indexCount : 0; }
+    unsigned lodCount() const { return (unsigned)lods_.size(); }
+    const Lod& lod(unsigned level) const { return lods_[level]; }
+
+    // Bytes uploaded for vertices and indices.
+    size_t vertexBytes() const { return vertexBytes_; }
+    size_t indexBytes() const { return indexBytes_; }
+
+    // Mesh-space bounds of the uploaded vertices.
+    const AABB& bounds() const { return bounds_; }
+    const Sphere& sphere() const { return sphere_; }
+
+private:
+    GLuint vaoId_ = 0;
+    GLuint vboId_[2] = { 0, 0 };
+    GLenum indexType_ = GL_UNSIGNED_INT;
+    VertexFormat format_ = FULL;
+    std::vector<Lod> lods_;
+    size_t vertexBytes_ = 0;
+    size_t indexBytes_ = 0;
+    AABB bounds_;
+    Sphere sphere_;
+};
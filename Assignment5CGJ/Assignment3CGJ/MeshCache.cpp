@@ -0,0 +1,203 @@
+#include "MeshCache.hpp"
+#include "MeshGeometry.hpp"
+#include "MeshSimplifier.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+static const char MAGIC[4] = { 'M', 'B', 'I', 'N' };
+
+// The level table after the indices stays 4-byte aligned.
+static size_t padded(size_t bytes) {
+    return (bytes + 3) & ~(size_t)3;
+}
+
+std::string MeshCache::cachePath(const std::string& source) {
+    return source + ".mbin";
+}
+
+// FNV-1a (64 bit) over the whole file; 0 when the file cannot be read.
+uint64_t MeshCache::hashFile(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) return 0;
+
+    uint64_t hash = 14695981039346656037ull;
+    const unsigned char* p = file.data();
+    for (size_t i = 0; i < file.size(); i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+bool MeshCache::load(const std::string& source) {
+    return open(source) || write(source, sourceHash_, MeshOptimizer::Options());
+}
+
+bool MeshCache::open(const std::string& source) {
+    close();
+    sourceHash_ = hashFile(source);
+    if (sourceHash_ == 0) return false;
+    fromCache_ = map(cachePath(source), sourceHash_);
+    return fromCache_;
+}
+
+bool MeshCache::map(const std::string& path, uint64_t expectedHash) {
+    if (!file_.open(path)) return false;
+    if (file_.size() < sizeof(Header)) {
+        file_.close();
+        return false;
+    }
+
+    const Header* h = reinterpret_cast<const Header*>(file_.data());
+    size_t stride = h->vertexFormat == MeshBuffers::PACKED ? sizeof(MeshBuffers::PackedVertex)
+        : sizeof(MeshBuffers::Vertex);
+    size_t expectedSize = sizeof(Header) + (size_t)h->vertexCount * stride
+        + padded((size_t)h->indexCount * h->indexSize) + (size_t)h->lodCount * sizeof(MeshBuffers::Lod);
+    if (std::memcmp(h->magic, MAGIC, 4) != 0 || h->version != VERSION || h->sourceHash != expectedHash
+        || h->vertexFormat > MeshBuffers::PACKED || h->vertexStride != stride
+        || (h->indexSize != 2 && h->indexSize != 4) || h->lodCount == 0 || file_.size() != expectedSize) {
+        file_.close();
+        return false;
+    }
+
+    header_ = h;
+    return true;
+}
+
+bool MeshCache::rebuild(const std::string& source, const MeshOptimizer::Options& options) {
+    return write(source, hashFile(source), options);
+}
+
+bool MeshCache::write(const std::string& source, uint64_t sourceHash, const MeshOptimizer::Options& options) {
+    close();
+    sourceHash_ = sourceHash;
+
+    MeshGeometry geometry;
+    if (!geometry.load(source, true, true)) return false;
+
+    MeshOptimizer::Mesh mesh;
+    mesh.vertices.resize(geometry.vertexCount());
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        mesh.vertices[i].position = geometry.positions[i];
+        mesh.vertices[i].normal = geometry.normals[i];
+        mesh.vertices[i].texcoord = geometry.texcoords[i];
+        mesh.vertices[i].tangent = geometry.tangents[i];
+    }
+    mesh.indices.assign(geometry.indices.begin(), geometry.indices.end());
+    mesh.lods = MeshSimplifier::buildLods(mesh.vertices.data(), mesh.vertices.size(), mesh.indices);
+    stages_ = MeshOptimizer::optimize(mesh, options);
+
+    Header h;
+    std::memcpy(h.magic, MAGIC, 4);
+    h.version = VERSION;
+    h.sourceHash = sourceHash_;
+    h.vertexCount = (uint32_t)mesh.vertices.size();
+    h.indexCount = (uint32_t)mesh.indices.size();
+    h.vertexStride = mesh.quantized() ? sizeof(MeshBuffers::PackedVertex) : sizeof(MeshBuffers::Vertex);
+    h.lodCount = (uint32_t)mesh.lods.size();
+    h.indexSize = mesh.shortIndices ? 2 : 4;
+    h.vertexFormat = mesh.quantized() ? MeshBuffers::PACKED : MeshBuffers::FULL;
+
+    std::vector<uint16_t> shortIndices;
+    if (mesh.shortIndices) shortIndices.assign(mesh.indices.begin(), mesh.indices.end());
+    const char* vertexData = mesh.quantized() ? reinterpret_cast<const char*>(mesh.packed.data())
+        : reinterpret_cast<const char*>(mesh.vertices.data());
+    const char* indexData = mesh.shortIndices ? reinterpret_cast<const char*>(shortIndices.data())
+        : reinterpret_cast<const char*>(mesh.indices.data());
+    size_t indexBytes = (size_t)h.indexCount * h.indexSize;
+    const char zeros[4] = {};
+
+    // Written under a name no other writer uses, then renamed over the
+    // cache: a mapping of the old cache is never truncated under its
+    // reader, and two writers for one source cannot interleave.
+    static std::atomic<unsigned> writes(0);
+    std::string path = cachePath(source);
+    std::string temp = path + "." + std::to_string(writes++) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Cannot write mesh cache " << temp << std::endl;
+            return false;
+        }
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(vertexData, (size_t)h.vertexCount * h.vertexStride);
+        out.write(indexData, indexBytes);
+        out.write(zeros, padded(indexBytes) - indexBytes);
+        out.write(reinterpret_cast<const char*>(mesh.lods.data()), mesh.lods.size() * sizeof(MeshBuffers::Lod));
+        if (!out.flush()) {
+            std::cerr << "Cannot write mesh cache " << temp << std::endl;
+            out.close();
+            std::remove(temp.c_str());
+            return false;
+        }
+    }
+    if (!MappedFile::replace(temp, path)) {
+        std::cerr << "Cannot replace mesh cache " << path << std::endl;
+        std::remove(temp.c_str());
+        return false;
+    }
+
+    fromCache_ = false;
+    return map(path, sourceHash_);
+}
+
+void MeshCache::close() {
+    file_.close();
+    header_ = nullptr;
+    fromCache_ = false;
+}
+
+const void* MeshCache::vertices() const {
+    if (!header_) return nullptr;
+    return file_.data() + sizeof(Header);
+}
+
+const void* MeshCache::indices() const {
+    if (!header_) return nullptr;
+    return file_.data() + sizeof(Header) + (size_t)header_->vertexCount * header_->vertexStride;
+}
+
+MeshBuffers::VertexFormat MeshCache::vertexFormat() const {
+    return header_ && header_->vertexFormat == MeshBuffers::PACKED ? MeshBuffers::PACKED : MeshBuffers::FULL;
+}
+
+GLenum MeshCache::indexType() const {
+    return header_ && header_->indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+const MeshBuffers::Lod* MeshCache::lods() const {
+    if (!header_) return nullptr;
+    const unsigned char* indexData = static_cast<const unsigned char*>(indices());
+    size_t indexBytes = padded((size_t)header_->indexCount * header_->indexSize);
+    return reinterpret_cast<const MeshBuffers::Lod*>(indexData + indexBytes);
+}
+
+void MeshCache::positions(std::vector<glm::vec3>& out) const {
+    out.resize(vertexCount());
+    if (vertexFormat() == MeshBuffers::PACKED) {
+        const MeshBuffers::PackedVertex* v = static_cast<const MeshBuffers::PackedVertex*>(vertices());
+        for (size_t i = 0; i < out.size(); i++) out[i] = MeshOptimizer::unpackPosition(v[i]);
+    }
+    else {
+        const MeshBuffers::Vertex* v = static_cast<const MeshBuffers::Vertex*>(vertices());
+        for (size_t i = 0; i < out.size(); i++) out[i] = v[i].position;
+    }
+}
+
+void MeshCache::baseIndices(std::vector<uint32_t>& out) const {
+    out.clear();
+    if (!header_) return;
+    const MeshBuffers::Lod& base = lods()[0];
+    if (indexType() == GL_UNSIGNED_SHORT) {
+        const uint16_t* p = static_cast<const uint16_t*>(indices()) + base.firstIndex;
+        out.assign(p, p + base.indexCount);
+    }
+    else {
+        const uint32_t* p = static_cast<const uint32_t*>(indices()) + base.firstIndex;
+        out.assign(p, p + base.indexCount);
+    }
+}
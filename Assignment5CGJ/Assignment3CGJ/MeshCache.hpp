@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "MappedFile.hpp"
+#include <vector>
+#include "MeshBuffers.hpp"
+#include "MeshOptimizer.hpp"
+
+// Binary mesh cache stored next to the source model as <source>.mbin:
+//
+//   Header | Vertex or PackedVertex [vertexCount] (interleaved)
+//          | uint16 or uint32 index[indexCount], padded to 4 bytes
+//          | MeshBuffers::Lod[lodCount]
+//
+// The indices hold every level of detail back to back, level 0 first; the
+// levels are generated with MeshSimplifier and then run through
+// MeshOptimizer when the cache is written.
+//
+// The header carries a hash of the source file; a cache whose hash no longer
+// matches is rebuilt. The file is memory-mapped, so the vertex and index
+// arrays can be handed straight to glBufferData.
+class MeshCache {
+public:
+    static const uint32_t VERSION = 3;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t vertexStride;
+        uint32_t lodCount;
+        uint32_t indexSize;     // 2 or 4
+        uint32_t vertexFormat;  // MeshBuffers::VertexFormat
+    };
+
+    static std::string cachePath(const std::string& source);
+    static uint64_t hashFile(const std::string& path);
+
+    // Maps the cache if it exists and matches the source; otherwise imports
+    // the source with Assimp, writes the cache and maps that.
+    bool load(const std::string& source);
+
+    // Maps the cache only if it is up to date.
+    bool open(const std::string& source);
+
+    // Re-imports the source and writes a fresh cache. stages() then holds
+    // the optimizer's measurements.
+    bool rebuild(const std::string& source, const MeshOptimizer::Options& options = MeshOptimizer::Options());
+
+    void close();
+
+    bool fromCache() const { return fromCache_; }
+    const void* vertices() const;
+    const void* indices() const;
+    MeshBuffers::VertexFormat vertexFormat() const;
+    GLenum indexType() const;
+    uint32_t vertexCount() const { return header_ ? header_->vertexCount : 0; }
+    uint32_t indexCount() const { return header_ ? header_->indexCount : 0; }   // all levels
+    const MeshBuffers::Lod* lods() const;
+    uint32_t lodCount() const { return header_ ? header_->lodCount : 0; }
+
+    // Decoded positions and level 0 indices, e.g. for building a MeshBVH.
+    void positions(std::vector<glm::vec3>& out) const;
+    void baseIndices(std::vector<uint32_t>& out) const;
+
+    const std::vector<MeshOptimizer::Stage>& stages() const { return stages_; }
+
+private:
+    MappedFile file_;
+    const Header* header_ = nullptr;
+    uint64_t sourceHash_ = 0;
+    bool fromCache_ = false;
+    std::vector<MeshOptimizer::Stage> stages_;
+
+    bool map(const std::string& path, uint64_t expectedHash);
+    bool write(const std::string& source, uint64_t sourceHash, const MeshOptimizer::Options& options);
+};
@@ -0,0 +1,67 @@
+#include "MeshGeometry.hpp"
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <iostream>
+
+bool MeshGeometry::load(const std::string& filename, bool joinIdenticalVertices, bool calculateTangents) {
+    unsigned int flags = aiProcess_Triangulate;
+    if (joinIdenticalVertices) flags |= aiProcess_JoinIdenticalVertices;
+    if (calculateTangents) flags |= aiProcess_CalcTangentSpace;
+
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(filename, flags);
+    if (!scene || (scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)) {
+        std::cerr << "Error while loading " << filename << ": " << importer.GetErrorString() << std::endl;
+        return false;
+    }
+
+    positions.clear();
+    normals.clear();
+    texcoords.clear();
+    tangents.clear();
+    indices.clear();
+
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+        const aiMesh* mesh = scene->mMeshes[m];
+        unsigned int baseVertex = (unsigned int)positions.size();
+
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+            const aiVector3D& p = mesh->mVertices[i];
+            positions.push_back(glm::vec3(p.x, p.y, p.z));
+
+            if (mesh->HasNormals()) {
+                const aiVector3D& n = mesh->mNormals[i];
+                normals.push_back(glm::vec3(n.x, n.y, n.z));
+            }
+            else {
+                normals.push_back(glm::vec3(0.0f));
+            }
+
+            if (mesh->HasTextureCoords(0)) {
+                const aiVector3D& t = mesh->mTextureCoords[0][i];
+                texcoords.push_back(glm::vec2(t.x, t.y));
+            }
+            else {
+                texcoords.push_back(glm::vec2(0.0f));
+            }
+
+            if (mesh->HasTangentsAndBitangents()) {
+                const aiVector3D& t = mesh->mTangents[i];
+                tangents.push_back(glm::vec3(t.x, t.y, t.z));
+            }
+            else {
+                tangents.push_back(glm::vec3(0.0f));
+            }
+        }
+
+        for (unsigned int f = 0; f < mesh->mNumFaces; f++) {
+            const aiFace& face = mesh->mFaces[f];
+            if (face.mNumIndices != 3) continue;
+            indices.push_back(baseVertex + face.mIndices[0]);
+            indices.push_back(baseVertex + face.mIndices[1]);
+            indices.push_back(baseVertex + face.mIndices[2]);
+        }
+    }
+    return true;
+}
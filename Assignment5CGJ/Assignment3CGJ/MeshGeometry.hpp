@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// CPU-side copy of a model file, imported with the same Assimp steps as
+// mgl::Mesh. Sub-meshes are flattened into one vertex/index list.
+struct MeshGeometry {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<glm::vec2> texcoords;
+    std::vector<glm::vec3> tangents;
+    std::vector<unsigned int> indices;
+
+    bool load(const std::string& filename, bool joinIdenticalVertices = true, bool calculateTangents = false);
+
+    size_t vertexCount() const { return positions.size(); }
+    size_t triangleCount() const { return indices.size() / 3; }
+};
@@ -0,0 +1,54 @@
+#include "MeshLibrary.hpp"
+
+void MeshLibrary::Handle::retain() {
+    if (entry_) entry_->references++;
+}
+
+void MeshLibrary::Handle::reset() {
+    if (entry_) entry_->references--;
+    entry_ = nullptr;
+}
+
+MeshBuffers* MeshLibrary::Handle::mesh() const {
+    return entry_ ? &entry_->mesh : nullptr;
+}
+
+const MeshBVH* MeshLibrary::Handle::bvh() const {
+    return entry_ ? &entry_->bvh : nullptr;
+}
+
+MeshLibrary::~MeshLibrary() {
+    for (auto& e : entries_) loader_.cancel(&e.second->mesh);
+}
+
+MeshLibrary::Handle MeshLibrary::acquire(const std::string& path) {
+    std::unique_ptr<Entry>& entry = entries_[path];
+    if (!entry) {
+        entry.reset(new Entry());
+        loader_.request(path, &entry->mesh, &entry->bvh);
+    }
+    return Handle(entry.get());
+}
+
+int MeshLibrary::collect() {
+    int freed = 0;
+    for (auto it = entries_.begin(); it != entries_.end();) {
+        if (it->second->references > 0) {
+            ++it;
+            continue;
+        }
+        loader_.cancel(&it->second->mesh);
+        it = entries_.erase(it);
+        freed++;
+    }
+    return freed;
+}
+
+bool MeshLibrary::reload(const std::string& path) {
+    auto it = entries_.find(path);
+    if (it == entries_.end()) return false;
+    Entry& entry = *it->second;
+    loader_.cancel(&entry.mesh);
+    loader_.request(path, &entry.mesh, &entry.bvh);
+    return true;
+}
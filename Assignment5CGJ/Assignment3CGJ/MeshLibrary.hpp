@@ -0,0 +1,69 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include "MeshBVH.hpp"
+#include "MeshBuffers.hpp"
+#include "MeshLoader.hpp"
+
+// Owns every mesh loaded from a file, with its picking BVH. acquire() hands
+// out reference-counted handles and shares one mesh between every request
+// for the same path; collect() frees the meshes no handle refers to any
+// more (their GL buffers included, so call it on the GL thread), cancelling
+// loads still in flight.
+class MeshLibrary {
+    struct Entry;
+
+public:
+    class Handle {
+    public:
+        Handle() = default;
+        Handle(const Handle& other) : entry_(other.entry_) { retain(); }
+        Handle(Handle&& other) noexcept : entry_(other.entry_) { other.entry_ = nullptr; }
+        Handle& operator=(Handle other) {
+            std::swap(entry_, other.entry_);
+            return *this;
+        }
+        ~Handle() { reset(); }
+
+        void reset();
+        MeshBuffers* mesh() const;
+        const MeshBVH* bvh() const;
+        explicit operator bool() const { return entry_ != nullptr; }
+
+    private:
+        friend class MeshLibrary;
+        Entry* entry_ = nullptr;
+
+        explicit Handle(Entry* entry) : entry_(entry) { retain(); }
+        void retain();
+    };
+
+    explicit MeshLibrary(MeshLoader& loader) : loader_(loader) {}
+    ~MeshLibrary();
+    MeshLibrary(const MeshLibrary&) = delete;
+    MeshLibrary& operator=(const MeshLibrary&) = delete;
+
+    // Queues the file on the loader the first time it is asked for.
+    Handle acquire(const std::string& path);
+
+    // Returns the number of meshes freed.
+    int collect();
+
+    // Loads the file again into the same mesh, so every node and handle
+    // keeps working; the old buffers are drawn until the loader uploads the
+    // new ones. False if the library does not hold the path.
+    bool reload(const std::string& path);
+
+    size_t size() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        MeshBuffers mesh;
+        MeshBVH bvh;
+        int references = 0;
+    };
+
+    MeshLoader& loader_;
+    std::unordered_map<std::string, std::unique_ptr<Entry>> entries_;
+};
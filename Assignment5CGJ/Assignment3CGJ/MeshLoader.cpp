@@ -0,0 +1,127 @@
+#include "MeshLoader.hpp"
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+MeshLoader::MeshLoader(unsigned threads) {
+    if (threads == 0) {
+        unsigned hw = std::thread::hardware_concurrency();
+        threads = std::max(1u, hw > 1 ? hw - 1 : 1u);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers_.emplace_back(&MeshLoader::work, this);
+    }
+}
+
+MeshLoader::~MeshLoader() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+        queue_.clear();
+    }
+    wake_.notify_all();
+    for (std::thread& t : workers_) t.join();
+}
+
+void MeshLoader::request(const std::string& filename, MeshBuffers* mesh, MeshBVH* bvh) {
+    std::unique_ptr<Job> job(new Job());
+    job->filename = filename;
+    job->mesh = mesh;
+    job->bvh = bvh;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(job));
+    }
+    pending_++;
+    wake_.notify_one();
+}
+
+// First queued job whose file no worker is loading, so a reload waits for
+// the (possibly cancelled) job before it rather than racing it on the cache.
+std::deque<std::unique_ptr<MeshLoader::Job>>::iterator MeshLoader::nextJob() {
+    return std::find_if(queue_.begin(), queue_.end(), [this](const std::unique_ptr<Job>& job) {
+        return std::none_of(working_.begin(), working_.end(),
+            [&](const Job* busy) { return busy->filename == job->filename; });
+    });
+}
+
+void MeshLoader::work() {
+    for (;;) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this] { return stop_ || nextJob() != queue_.end(); });
+            if (stop_) return;
+            auto next = nextJob();
+            job = std::move(*next);
+            queue_.erase(next);
+            working_.push_back(job.get());
+        }
+
+        job->ok = job->cache.load(job->filename);
+        if (job->ok && job->bvh) {
+            // Picking only needs level 0; decoded since the cache may hold
+            // quantized vertices and 16-bit indices.
+            std::vector<glm::vec3> positions;
+            std::vector<uint32_t> indices;
+            job->cache.positions(positions);
+            job->cache.baseIndices(indices);
+            job->builtBvh.build(positions.data(), sizeof(glm::vec3), indices.data(), indices.size());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            working_.erase(std::find(working_.begin(), working_.end(), job.get()));
+            if (!job->cancelled) done_.push_back(std::move(job));
+        }
+        // A job held back for this file may run now.
+        wake_.notify_all();
+    }
+}
+
+void MeshLoader::cancel(const MeshBuffers* mesh) {
+    auto matches = [mesh](const std::unique_ptr<Job>& job) { return job->mesh == mesh; };
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (std::deque<std::unique_ptr<Job>>* list : { &queue_, &done_ }) {
+        auto end = std::remove_if(list->begin(), list->end(), matches);
+        pending_ -= list->end() - end;
+        list->erase(end, list->end());
+    }
+    for (Job* job : working_) {
+        if (job->mesh == mesh && !job->cancelled) {
+            job->cancelled = true;
+            pending_--;
+        }
+    }
+}
+
+int MeshLoader::upload(size_t byteBudget) {
+    int uploaded = 0;
+    size_t bytes = 0;
+    while (bytes < byteBudget || uploaded == 0) {
+        std::unique_ptr<Job> job;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (done_.empty()) break;
+            job = std::move(done_.front());
+            done_.pop_front();
+        }
+        pending_--;
+
+        if (!job->ok) {
+            std::cerr << "Mesh " << job->filename << " failed to load" << std::endl;
+            failed_++;
+            continue;
+        }
+
+        const MeshCache& cache = job->cache;
+        job->mesh->create(cache.vertices(), cache.vertexFormat(), cache.vertexCount(), cache.indices(),
+            cache.indexType(), cache.indexCount(), cache.lods(), cache.lodCount());
+        if (job->bvh) *job->bvh = std::move(job->builtBvh);
+        bytes += job->mesh->vertexBytes() + job->mesh->indexBytes();
+        uploaded++;
+        loaded_++;
+        if (cache.fromCache()) fromCache_++;
+    }
+    return uploaded;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "MeshBVH.hpp"
+#include "MeshBuffers.hpp"
+#include "MeshCache.hpp"
+
+// Loads meshes on a pool of worker threads. Workers do the file I/O, the
+// Assimp import (welding, tangents) through MeshCache and the BVH build;
+// the GL thread only uploads finished meshes in upload(), a few per frame.
+// Scene nodes can reference a requested mesh right away; it stays empty
+// (ready() == false) until its upload.
+class MeshLoader {
+public:
+    // 0 threads picks one less than the hardware concurrency (at least 1).
+    explicit MeshLoader(unsigned threads = 0);
+    ~MeshLoader();
+    MeshLoader(const MeshLoader&) = delete;
+    MeshLoader& operator=(const MeshLoader&) = delete;
+
+    // Fills mesh (and bvh, if given) on the GL thread during upload(). Both
+    // are owned by the caller and must outlive the loader's work on them. A
+    // mesh uploaded before is replaced in place; if the file fails to load
+    // it keeps its old contents.
+    void request(const std::string& filename, MeshBuffers* mesh, MeshBVH* bvh = nullptr);
+
+    // GL thread: uploads finished meshes until about byteBudget bytes were
+    // sent (always at least one). Returns the number of meshes uploaded.
+    int upload(size_t byteBudget);
+
+    // Forgets every request for `mesh`, so the caller may free it (and its
+    // BVH) right away. A worker still loading it drops the result; requests
+    // for the same file wait until that worker is done.
+    void cancel(const MeshBuffers* mesh);
+
+    // Meshes requested but not uploaded yet.
+    size_t pending() const { return pending_; }
+    int loadedCount() const { return loaded_; }
+    int fromCacheCount() const { return fromCache_; }
+    int failedCount() const { return failed_; }
+
+private:
+    struct Job {
+        std::string filename;
+        MeshBuffers* mesh = nullptr;
+        MeshBVH* bvh = nullptr;
+        MeshCache cache;
+        MeshBVH builtBvh;
+        bool ok = false;
+        bool cancelled = false;
+    };
+
+    std::vector<std::thread> workers_;
+    std::deque<std::unique_ptr<Job>> queue_;
+    std::deque<std::unique_ptr<Job>> done_;
+    std::vector<Job*> working_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+
+    size_t pending_ = 0;
+    int loaded_ = 0;
+    int fromCache_ = 0;
+    int failed_ = 0;
+
+    void work();
+    std::deque<std::unique_ptr<Job>>::iterator nextJob();
+};
@@ -0,0 +1,364 @@
+#include "MeshOptimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+static_assert(sizeof(MeshBuffers::PackedVertex) == 20, "PackedVertex must stay tightly packed");
+
+namespace MeshOptimizer {
+namespace {
+
+// Forsyth's scoring, tuned for a 32 entry LRU cache.
+const int SCORE_CACHE_SIZE = 32;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float CACHE_DECAY_POWER = 1.5f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float vertexScore(int cachePosition, uint32_t remaining) {
+    if (remaining == 0) return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // Used by the triangle just emitted: scored the same whatever
+            // the order, so the next triangle does not just reuse it.
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else {
+            float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    // Vertices with few triangles left are finished off first.
+    return score + VALENCE_BOOST_SCALE * std::pow((float)remaining, -VALENCE_BOOST_POWER);
+}
+
+uint16_t toHalf(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, 4);
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (exponent <= 0) {
+        // Subnormal or zero.
+        if (exponent < -10) return (uint16_t)sign;
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return (uint16_t)(sign | half);
+    }
+    if (exponent >= 31) return (uint16_t)(sign | 0x7c00);
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;  // round half up; may carry into the exponent
+    return (uint16_t)half;
+}
+
+float fromHalf(uint16_t half) {
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0) {
+        float value = std::ldexp((float)mantissa, -24);
+        return sign ? -value : value;
+    }
+    if (exponent == 31) bits = sign | 0x7f800000 | (mantissa << 13);
+    else bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    float value;
+    std::memcpy(&value, &bits, 4);
+    return value;
+}
+
+int16_t toSnorm(float value) {
+    return (int16_t)std::lround(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+uint16_t toUnorm(float value) {
+    return (uint16_t)std::lround(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f);
+}
+
+// Octahedral mapping: project onto |x| + |y| + |z| = 1 and fold the lower
+// half over the diagonals, giving two coordinates in [-1, 1].
+void encodeOctahedral(glm::vec3 n, int16_t out[2]) {
+    float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+    if (sum <= 0.0f) {
+        out[0] = out[1] = 0;
+        return;
+    }
+    n /= sum;
+    float x = n.x, y = n.y;
+    if (n.z < 0.0f) {
+        x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+        y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    out[0] = toSnorm(x);
+    out[1] = toSnorm(y);
+}
+
+size_t indexBytes(const Mesh& mesh) {
+    return mesh.indices.size() * (mesh.shortIndices ? sizeof(uint16_t) : sizeof(uint32_t));
+}
+
+size_t vertexBytes(const Mesh& mesh) {
+    return mesh.quantized() ? mesh.packed.size() * sizeof(MeshBuffers::PackedVertex)
+        : mesh.vertices.size() * sizeof(MeshBuffers::Vertex);
+}
+
+Stage measure(const Mesh& mesh, const std::string& name) {
+    const MeshBuffers::Lod& base = mesh.lods[0];
+    return { name, acmr(mesh.indices.data() + base.firstIndex, base.indexCount), vertexBytes(mesh),
+        indexBytes(mesh) };
+}
+
+}
+
+float acmr(const uint32_t* indices, size_t indexCount, size_t cacheSize) {
+    if (indexCount < 3) return 0.0f;
+    uint32_t vertexCount = *std::max_element(indices, indices + indexCount) + 1;
+
+    // A vertex is cached if fewer than cacheSize misses happened since it was loaded.
+    std::vector<size_t> loadedAt(vertexCount, SIZE_MAX);
+    size_t misses = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        size_t& at = loadedAt[indices[i]];
+        if (at == SIZE_MAX || misses - at >= cacheSize) {
+            at = misses;
+            misses++;
+        }
+    }
+    return (float)misses / (indexCount / 3);
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) return;
+
+    // Triangles of every vertex; the first remaining[v] entries are the ones
+    // not emitted yet.
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (size_t i = 0; i < indexCount; i++) remaining[indices[i]]++;
+    std::vector<uint32_t> first(vertexCount + 1, 0);
+    for (size_t v = 0; v < vertexCount; v++) first[v + 1] = first[v] + remaining[v];
+    std::vector<uint32_t> adjacency(indexCount);
+    {
+        std::vector<uint32_t> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indexCount; i++) adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) score[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScore(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        triangleScore[t] = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+    }
+    std::vector<uint8_t> emitted(triangleCount, 0);
+
+    std::vector<uint32_t> out;
+    out.reserve(indexCount);
+    std::vector<uint32_t> cache, next;
+    size_t scan = 0;
+    long best = (long)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin());
+
+    while (out.size() < indexCount) {
+        if (best < 0) {
+            // Nothing left around the cache: continue with the next triangle
+            // in input order.
+            while (emitted[scan]) scan++;
+            best = (long)scan;
+        }
+        const uint32_t* triangle = indices + 3 * best;
+        out.insert(out.end(), triangle, triangle + 3);
+        emitted[best] = 1;
+
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            uint32_t* list = &adjacency[first[v]];
+            uint32_t* end = list + remaining[v];
+            std::iter_swap(std::find(list, end, (uint32_t)best), end - 1);
+            remaining[v]--;
+        }
+
+        // LRU: the triangle's vertices move to the front.
+        next.assign(triangle, triangle + 3);
+        for (uint32_t v : cache) {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) next.push_back(v);
+        }
+        for (size_t k = 0; k < next.size(); k++) {
+            uint32_t v = next[k];
+            cachePosition[v] = k < (size_t)SCORE_CACHE_SIZE ? (int)k : -1;
+            float updated = vertexScore(cachePosition[v], remaining[v]);
+            float delta = updated - score[v];
+            score[v] = updated;
+            for (uint32_t j = first[v]; j < first[v] + remaining[v]; j++) triangleScore[adjacency[j]] += delta;
+        }
+        if (next.size() > (size_t)SCORE_CACHE_SIZE) next.resize(SCORE_CACHE_SIZE);
+        cache.swap(next);
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (uint32_t v : cache) {
+            for (uint32_t j = first[v]; j < first[v] + remaining[v]; j++) {
+                uint32_t t = adjacency[j];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+    }
+    std::copy(out.begin(), out.end(), indices);
+}
+
+void optimizeOverdraw(const MeshBuffers::Vertex* vertices, uint32_t* indices, size_t indexCount) {
+    size_t triangleCount = indexCount / 3;
+    if (triangleCount < 2) return;
+    uint32_t vertexCount = *std::max_element(indices, indices + indexCount) + 1;
+
+    // Cluster boundaries: triangles whose three vertices all miss a 16
+    // entry FIFO cache, i.e. where the vertex cache order restarts anyway.
+    const size_t cacheSize = 16;
+    std::vector<size_t> loadedAt(vertexCount, SIZE_MAX);
+    size_t misses = 0;
+    std::vector<size_t> clusters;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int triangleMisses = 0;
+        for (int k = 0; k < 3; k++) {
+            size_t& at = loadedAt[indices[3 * t + k]];
+            if (at == SIZE_MAX || misses - at >= cacheSize) {
+                at = misses;
+                misses++;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3) clusters.push_back(t);
+    }
+    clusters.push_back(triangleCount);
+    size_t clusterCount = clusters.size() - 1;
+    if (clusterCount < 2) return;
+
+    // Area-weighted centroid and normal per cluster and for the whole mesh.
+    std::vector<glm::vec3> centroid(clusterCount), normal(clusterCount);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const glm::vec3& a = vertices[indices[3 * t]].position;
+            const glm::vec3& b = vertices[indices[3 * t + 1]].position;
+            const glm::vec3& d = vertices[indices[3 * t + 2]].position;
+            glm::vec3 n = glm::cross(b - a, d - a);
+            float w = glm::length(n);
+            centroid[c] += (a + b + d) * (w / 3.0f);
+            normal[c] += n;
+            area += w;
+        }
+        meshCentroid += centroid[c];
+        meshArea += area;
+        if (area > 0.0f) centroid[c] /= area;
+    }
+    if (meshArea > 0.0f) meshCentroid /= meshArea;
+
+    std::vector<float> sortKey(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        float length = glm::length(normal[c]);
+        sortKey[c] = length > 0.0f ? glm::dot(centroid[c] - meshCentroid, normal[c] / length) : 0.0f;
+    }
+    std::vector<size_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKey[a] > sortKey[b]; });
+
+    std::vector<uint32_t> out;
+    out.reserve(indexCount);
+    for (size_t c : order) out.insert(out.end(), indices + 3 * clusters[c], indices + 3 * clusters[c + 1]);
+    std::copy(out.begin(), out.end(), indices);
+}
+
+size_t optimizeVertexFetch(std::vector<MeshBuffers::Vertex>& vertices, std::vector<uint32_t>& indices) {
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<MeshBuffers::Vertex> out;
+    out.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == UINT32_MAX) {
+            remap[index] = (uint32_t)out.size();
+            out.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(out);
+    return vertices.size();
+}
+
+bool canPack(const std::vector<MeshBuffers::Vertex>& vertices) {
+    for (const MeshBuffers::Vertex& v : vertices) {
+        if (v.texcoord.x < 0.0f || v.texcoord.x > 1.0f || v.texcoord.y < 0.0f || v.texcoord.y > 1.0f) return false;
+        for (int k = 0; k < 3; k++) {
+            if (std::fabs(v.position[k]) > 65504.0f) return false;
+        }
+    }
+    return true;
+}
+
+MeshBuffers::PackedVertex pack(const MeshBuffers::Vertex& vertex) {
+    MeshBuffers::PackedVertex p;
+    for (int k = 0; k < 3; k++) p.position[k] = toHalf(vertex.position[k]);
+    p.position[3] = toHalf(1.0f);
+    encodeOctahedral(vertex.normal, p.normal);
+    encodeOctahedral(vertex.tangent, p.tangent);
+    p.texcoord[0] = toUnorm(vertex.texcoord.x);
+    p.texcoord[1] = toUnorm(vertex.texcoord.y);
+    return p;
+}
+
+glm::vec3 unpackPosition(const MeshBuffers::PackedVertex& vertex) {
+    return glm::vec3(fromHalf(vertex.position[0]), fromHalf(vertex.position[1]), fromHalf(vertex.position[2]));
+}
+
+// Same decoding as octDecode() in the vertex shaders.
+glm::vec3 unpackNormal(const MeshBuffers::PackedVertex& vertex) {
+    glm::vec3 n(std::max(vertex.normal[0] / 32767.0f, -1.0f), std::max(vertex.normal[1] / 32767.0f, -1.0f), 0.0f);
+    n.z = 1.0f - std::fabs(n.x) - std::fabs(n.y);
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+std::vector<Stage> optimize(Mesh& mesh, const Options& options) {
+    std::vector<Stage> stages;
+    if (mesh.lods.empty()) mesh.lods.push_back({ 0, (uint32_t)mesh.indices.size(), 0.0f });
+    stages.push_back(measure(mesh, "input"));
+
+    for (const MeshBuffers::Lod& lod : mesh.lods) {
+        optimizeVertexCache(mesh.indices.data() + lod.firstIndex, lod.indexCount, mesh.vertices.size());
+    }
+    stages.push_back(measure(mesh, "vertex cache"));
+
+    for (const MeshBuffers::Lod& lod : mesh.lods) {
+        optimizeOverdraw(mesh.vertices.data(), mesh.indices.data() + lod.firstIndex, lod.indexCount);
+    }
+    stages.push_back(measure(mesh, "overdraw"));
+
+    // Level 0 comes first in the indices, so its order decides the layout.
+    optimizeVertexFetch(mesh.vertices, mesh.indices);
+    stages.push_back(measure(mesh, "vertex fetch"));
+
+    mesh.shortIndices = mesh.vertices.size() <= 65536;
+    stages.push_back(measure(mesh, mesh.shortIndices ? "index width (16 bit)" : "index width (32 bit)"));
+
+    if (options.quantize) {
+        if (canPack(mesh.vertices)) {
+            mesh.packed.resize(mesh.vertices.size());
+            std::transform(mesh.vertices.begin(), mesh.vertices.end(), mesh.packed.begin(), pack);
+            stages.push_back(measure(mesh, "quantization"));
+        }
+        else {
+            stages.push_back(measure(mesh, "quantization (skipped: attributes out of range)"));
+        }
+    }
+    return stages;
+}
+
+}
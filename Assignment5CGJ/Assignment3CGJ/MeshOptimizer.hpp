@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MeshBuffers.hpp"
+
+// Post-processing applied to meshes when the mesh cache is written. No stage
+// changes what is rendered, only how cheaply it is fetched and shaded:
+//
+//   vertex cache   reorders each level's triangles (Forsyth's linear-speed
+//                  algorithm) so consecutive triangles reuse transformed
+//                  vertices;
+//   overdraw       cuts that order where the cache restarts anyway and sorts
+//                  the pieces outward-facing first, so likely occluders are
+//                  drawn before what they hide;
+//   vertex fetch   renumbers vertices in order of first use, dropping unused
+//                  ones, so vertex reads walk the buffer forwards;
+//   index width    16-bit indices when there are at most 65536 vertices;
+//   quantization   (optional) MeshBuffers::PackedVertex, 20 bytes instead of 44.
+namespace MeshOptimizer {
+
+struct Options {
+    bool quantize = false;
+};
+
+// Measured after every stage, for the --convert report.
+struct Stage {
+    std::string name;
+    float acmr;             // level 0
+    size_t vertexBytes;
+    size_t indexBytes;
+};
+
+struct Mesh {
+    std::vector<MeshBuffers::Vertex> vertices;
+    std::vector<MeshBuffers::PackedVertex> packed;  // replaces vertices when quantized
+    std::vector<uint32_t> indices;                  // every level, back to back
+    std::vector<MeshBuffers::Lod> lods;
+    bool shortIndices = false;
+
+    bool quantized() const { return !packed.empty(); }
+};
+
+// Runs every stage on every level of `mesh`.
+std::vector<Stage> optimize(Mesh& mesh, const Options& options);
+
+// Average cache miss ratio: vertices transformed per triangle on a FIFO
+// post-transform cache, from 0.5 (ideal for large grids) to 3.
+float acmr(const uint32_t* indices, size_t indexCount, size_t cacheSize = 16);
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+void optimizeOverdraw(const MeshBuffers::Vertex* vertices, uint32_t* indices, size_t indexCount);
+
+// Renumbers vertices in order of first use in `indices`; returns the new count.
+size_t optimizeVertexFetch(std::vector<MeshBuffers::Vertex>& vertices, std::vector<uint32_t>& indices);
+
+// Quantization needs texture coordinates in [0, 1] and positions within
+// half-float range.
+bool canPack(const std::vector<MeshBuffers::Vertex>& vertices);
+MeshBuffers::PackedVertex pack(const MeshBuffers::Vertex& vertex);
+glm::vec3 unpackPosition(const MeshBuffers::PackedVertex& vertex);
+glm::vec3 unpackNormal(const MeshBuffers::PackedVertex& vertex);
+
+}
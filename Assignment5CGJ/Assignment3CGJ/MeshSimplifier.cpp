@@ -0,0 +1,263 @@
+#include "MeshSimplifier.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <tuple>
+
+// Constraint planes along open borders count this many times a face plane.
+static const double BOUNDARY_WEIGHT = 10.0;
+
+// Smallest cosine allowed between a triangle's normal before and after a collapse.
+static const float MIN_NORMAL_COSINE = 0.2f;
+
+void MeshSimplifier::Quadric::addPlane(const glm::vec3& n, double d, double weight) {
+    double a = n.x, b = n.y, c = n.z;
+    q[0] += weight * a * a;
+    q[1] += weight * a * b;
+    q[2] += weight * a * c;
+    q[3] += weight * a * d;
+    q[4] += weight * b * b;
+    q[5] += weight * b * c;
+    q[6] += weight * b * d;
+    q[7] += weight * c * c;
+    q[8] += weight * c * d;
+    q[9] += weight * d * d;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric& other) {
+    for (int i = 0; i < 10; i++) q[i] += other.q[i];
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::vec3& p) const {
+    double x = p.x, y = p.y, z = p.z;
+    return q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+        + q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+        + q[7] * z * z + 2.0 * q[8] * z + q[9];
+}
+
+MeshSimplifier::MeshSimplifier(const MeshBuffers::Vertex* vertices, size_t vertexCount, const uint32_t* indices,
+    size_t indexCount)
+    : vertices_(vertices) {
+    // Weld by exact position, so seams do not open up as borders.
+    std::map<std::tuple<float, float, float>, uint32_t> ids;
+    positionOf_.resize(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        const glm::vec3& p = vertices[v].position;
+        auto inserted = ids.emplace(std::make_tuple(p.x, p.y, p.z), (uint32_t)positions_.size());
+        if (inserted.second) {
+            positions_.push_back(p);
+            vertexList_.emplace_back();
+        }
+        positionOf_[v] = inserted.first->second;
+        vertexList_[positionOf_[v]].push_back((uint32_t)v);
+    }
+    size_t positionCount = positions_.size();
+    quadrics_.resize(positionCount);
+    stamp_.assign(positionCount, 0);
+    removed_.assign(positionCount, 0);
+    triangleList_.resize(positionCount);
+
+    // Triangles whose corners share a position draw nothing and are dropped.
+    std::map<std::pair<uint32_t, uint32_t>, int> edgeUse;
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        uint32_t p[3] = { positionOf_[indices[i]], positionOf_[indices[i + 1]], positionOf_[indices[i + 2]] };
+        if (p[0] == p[1] || p[1] == p[2] || p[0] == p[2]) continue;
+
+        uint32_t t = (uint32_t)alive_.size();
+        for (int k = 0; k < 3; k++) {
+            corners_.push_back(indices[i + k]);
+            cornerPosition_.push_back(p[k]);
+            triangleList_[p[k]].push_back(t);
+            edgeUse[std::minmax(p[k], p[(k + 1) % 3])]++;
+        }
+        alive_.push_back(1);
+
+        glm::vec3 n = glm::cross(positions_[p[1]] - positions_[p[0]], positions_[p[2]] - positions_[p[0]]);
+        float length = glm::length(n);
+        if (length <= 0.0f) continue;
+        n /= length;
+        double d = -glm::dot(n, positions_[p[0]]);
+        for (int k = 0; k < 3; k++) quadrics_[p[k]].addPlane(n, d, 1.0);
+    }
+    triangles_ = alive_.size();
+
+    // A border edge gets a plane through it, perpendicular to its triangle.
+    for (size_t t = 0; t < alive_.size(); t++) {
+        const uint32_t* p = &cornerPosition_[3 * t];
+        glm::vec3 face = triangleNormal((uint32_t)t, UINT32_MAX, UINT32_MAX);
+        for (int k = 0; k < 3; k++) {
+            uint32_t a = p[k], b = p[(k + 1) % 3];
+            if (edgeUse[std::minmax(a, b)] != 1) continue;
+            glm::vec3 n = glm::cross(positions_[b] - positions_[a], face);
+            float length = glm::length(n);
+            if (length <= 0.0f) continue;
+            n /= length;
+            double d = -glm::dot(n, positions_[a]);
+            quadrics_[a].addPlane(n, d, BOUNDARY_WEIGHT);
+            quadrics_[b].addPlane(n, d, BOUNDARY_WEIGHT);
+        }
+    }
+
+    for (size_t t = 0; t < alive_.size(); t++) {
+        const uint32_t* p = &cornerPosition_[3 * t];
+        for (int k = 0; k < 3; k++) {
+            // Each interior edge is seen from both triangles; push it once.
+            if (p[k] < p[(k + 1) % 3] || edgeUse[std::minmax(p[k], p[(k + 1) % 3])] == 1) push(p[k], p[(k + 1) % 3]);
+        }
+    }
+}
+
+glm::vec3 MeshSimplifier::triangleNormal(uint32_t triangle, uint32_t replace, uint32_t with) const {
+    glm::vec3 p[3];
+    for (int k = 0; k < 3; k++) {
+        uint32_t id = cornerPosition_[3 * triangle + k];
+        p[k] = positions_[id == replace ? with : id];
+    }
+    return glm::cross(p[1] - p[0], p[2] - p[0]);
+}
+
+// Both directions of the edge: if the cheaper one turns out invalid, the
+// other may still be fine.
+void MeshSimplifier::push(uint32_t a, uint32_t b) {
+    Quadric q = quadrics_[a];
+    q.add(quadrics_[b]);
+    double toB = std::max(q.evaluate(positions_[b]), 0.0);
+    double toA = std::max(q.evaluate(positions_[a]), 0.0);
+    heap_.push_back({ toB, a, b, stamp_[a], stamp_[b] });
+    std::push_heap(heap_.begin(), heap_.end());
+    heap_.push_back({ toA, b, a, stamp_[b], stamp_[a] });
+    std::push_heap(heap_.begin(), heap_.end());
+}
+
+bool MeshSimplifier::collapse(uint32_t from, uint32_t to) {
+    // Triangles on the edge disappear; the rest must keep their orientation.
+    int shared = 0;
+    std::vector<uint32_t> fromRing, toRing, opposite;
+    for (uint32_t t : triangleList_[from]) {
+        if (!alive_[t]) continue;
+        const uint32_t* p = &cornerPosition_[3 * t];
+        bool onEdge = p[0] == to || p[1] == to || p[2] == to;
+        for (int k = 0; k < 3; k++) {
+            if (p[k] == from) continue;
+            fromRing.push_back(p[k]);
+            if (onEdge && p[k] != to) opposite.push_back(p[k]);
+        }
+        if (onEdge) {
+            shared++;
+            continue;
+        }
+        glm::vec3 before = triangleNormal(t, UINT32_MAX, UINT32_MAX);
+        glm::vec3 after = triangleNormal(t, from, to);
+        float lengths = glm::length(before) * glm::length(after);
+        if (lengths <= 0.0f || glm::dot(before, after) < MIN_NORMAL_COSINE * lengths) return false;
+    }
+    if (shared == 0) return false;
+
+    // Link condition: the only vertices adjacent to both ends may be those
+    // opposite the edge, or the collapse pinches the surface.
+    for (uint32_t t : triangleList_[to]) {
+        if (!alive_[t]) continue;
+        for (int k = 0; k < 3; k++) toRing.push_back(cornerPosition_[3 * t + k]);
+    }
+    std::sort(fromRing.begin(), fromRing.end());
+    fromRing.erase(std::unique(fromRing.begin(), fromRing.end()), fromRing.end());
+    std::sort(toRing.begin(), toRing.end());
+    toRing.erase(std::unique(toRing.begin(), toRing.end()), toRing.end());
+    std::sort(opposite.begin(), opposite.end());
+    opposite.erase(std::unique(opposite.begin(), opposite.end()), opposite.end());
+    for (uint32_t v : fromRing) {
+        if (v != to && std::binary_search(toRing.begin(), toRing.end(), v)
+            && !std::binary_search(opposite.begin(), opposite.end(), v)) {
+            return false;
+        }
+    }
+
+    for (uint32_t t : triangleList_[from]) {
+        if (!alive_[t]) continue;
+        uint32_t* p = &cornerPosition_[3 * t];
+        if (p[0] == to || p[1] == to || p[2] == to) {
+            alive_[t] = 0;
+            triangles_--;
+            continue;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (p[k] == from) p[k] = to;
+        }
+        triangleList_[to].push_back(t);
+    }
+    quadrics_[to].add(quadrics_[from]);
+    removed_[from] = 1;
+    stamp_[to]++;
+    std::vector<uint32_t>().swap(triangleList_[from]);
+
+    std::vector<uint32_t>& list = triangleList_[to];
+    list.erase(std::remove_if(list.begin(), list.end(), [this](uint32_t t) { return !alive_[t]; }), list.end());
+    for (uint32_t v : toRing) {
+        if (v != to && v != from && !removed_[v]) push(to, v);
+    }
+    for (uint32_t v : fromRing) {
+        if (v != to && !std::binary_search(toRing.begin(), toRing.end(), v)) push(to, v);
+    }
+    return true;
+}
+
+void MeshSimplifier::simplify(size_t targetTriangles) {
+    while (triangles_ > targetTriangles && !heap_.empty()) {
+        std::pop_heap(heap_.begin(), heap_.end());
+        Candidate c = heap_.back();
+        heap_.pop_back();
+        if (removed_[c.from] || removed_[c.to]) continue;
+        if (stamp_[c.from] != c.fromStamp || stamp_[c.to] != c.toStamp) continue;
+        if (collapse(c.from, c.to)) error_ = std::max(error_, (float)std::sqrt(c.cost));
+    }
+}
+
+void MeshSimplifier::appendIndices(std::vector<uint32_t>& out) const {
+    for (size_t t = 0; t < alive_.size(); t++) {
+        if (!alive_[t]) continue;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = corners_[3 * t + k];
+            uint32_t p = cornerPosition_[3 * t + k];
+            if (positionOf_[v] != p) {
+                // Moved: take the vertex at the new position that best
+                // matches this corner's normal, then its texture coordinate.
+                const MeshBuffers::Vertex& original = vertices_[v];
+                float best = -2.0f;
+                float bestUv = 0.0f;
+                for (uint32_t w : vertexList_[p]) {
+                    float score = glm::dot(original.normal, vertices_[w].normal);
+                    float uv = glm::length(original.texcoord - vertices_[w].texcoord);
+                    if (score > best + 1e-4f || (score > best - 1e-4f && uv < bestUv)) {
+                        best = score;
+                        bestUv = uv;
+                        v = w;
+                    }
+                }
+            }
+            out.push_back(v);
+        }
+    }
+}
+
+std::vector<MeshBuffers::Lod> MeshSimplifier::buildLods(const MeshBuffers::Vertex* vertices, size_t vertexCount,
+    std::vector<uint32_t>& indices, int maxLevels, float ratio, size_t minTriangles) {
+    std::vector<MeshBuffers::Lod> lods;
+    lods.push_back({ 0, (uint32_t)indices.size(), 0.0f });
+    if (maxLevels <= 1 || indices.size() / 3 < 2 * minTriangles) return lods;
+
+    MeshSimplifier simplifier(vertices, vertexCount, indices.data(), indices.size());
+    size_t previous = simplifier.triangleCount();
+    for (int level = 1; level < maxLevels; level++) {
+        size_t target = (size_t)(previous * ratio);
+        if (target < minTriangles) break;
+        simplifier.simplify(target);
+        size_t count = simplifier.triangleCount();
+        if (count * 10 > previous * 9) break;
+
+        uint32_t first = (uint32_t)indices.size();
+        simplifier.appendIndices(indices);
+        lods.push_back({ first, (uint32_t)(indices.size() - first), simplifier.error() });
+        previous = count;
+    }
+    return lods;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "MeshBuffers.hpp"
+
+// Quadric error edge collapse (Garland & Heckbert) restricted to half-edge
+// collapses: a vertex is always merged into one of its neighbours, so every
+// simplified level indexes the original vertex array and only the index
+// list changes. Vertices that share a position (UV or normal seams) are
+// collapsed together; each output corner picks, among the vertices at its
+// new position, the one whose normal is closest to the corner's original.
+//
+// Boundary edges get a constraint plane so open borders keep their shape.
+// Collapses that would flip or degenerate a neighbouring triangle are
+// rejected.
+class MeshSimplifier {
+public:
+    MeshSimplifier(const MeshBuffers::Vertex* vertices, size_t vertexCount, const uint32_t* indices,
+        size_t indexCount);
+
+    // Collapses edges, cheapest first, until at most `targetTriangles`
+    // remain or no valid collapse is left. Can be called repeatedly with
+    // decreasing targets; each call continues from the previous result.
+    void simplify(size_t targetTriangles);
+
+    size_t triangleCount() const { return triangles_; }
+
+    // Largest distance (mesh units, approximate) between the simplified and
+    // the original surface so far.
+    float error() const { return error_; }
+
+    // Appends the current triangles to `out`.
+    void appendIndices(std::vector<uint32_t>& out) const;
+
+    // Appends up to `maxLevels` - 1 simplified copies of the triangles to
+    // `indices`, each with about `ratio` times the triangles of the previous
+    // level, and returns the level table; level 0 is the original range.
+    // Stops early when a level would remove less than a tenth of the
+    // triangles or drop below `minTriangles`.
+    static std::vector<MeshBuffers::Lod> buildLods(const MeshBuffers::Vertex* vertices, size_t vertexCount,
+        std::vector<uint32_t>& indices, int maxLevels = 4, float ratio = 0.5f, size_t minTriangles = 32);
+
+private:
+    // Symmetric 4x4 matrix: a2 ab ac ad b2 bc bd c2 cd d2.
+    struct Quadric {
+        double q[10] = {};
+
+        void addPlane(const glm::vec3& n, double d, double weight);
+        void add(const Quadric& other);
+        double evaluate(const glm::vec3& p) const;
+    };
+
+    struct Candidate {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromStamp;
+        uint32_t toStamp;
+
+        bool operator<(const Candidate& other) const { return cost > other.cost; }
+    };
+
+    const MeshBuffers::Vertex* vertices_;
+    std::vector<uint32_t> positionOf_;              // vertex -> position id
+    std::vector<glm::vec3> positions_;
+    std::vector<std::vector<uint32_t>> vertexList_;  // position id -> vertices
+    std::vector<Quadric> quadrics_;
+    std::vector<uint32_t> stamp_;                   // bumped whenever a position changes
+    std::vector<uint8_t> removed_;
+    std::vector<std::vector<uint32_t>> triangleList_;  // position id -> triangles (may hold dead ones)
+
+    std::vector<uint32_t> corners_;                 // original vertex of each triangle corner
+    std::vector<uint32_t> cornerPosition_;          // current position id of each corner
+    std::vector<uint8_t> alive_;
+    std::vector<Candidate> heap_;
+    size_t triangles_ = 0;
+    float error_ = 0.0f;
+
+    glm::vec3 triangleNormal(uint32_t triangle, uint32_t replace, uint32_t with) const;
+    void push(uint32_t a, uint32_t b);
+    bool collapse(uint32_t from, uint32_t to);
+};
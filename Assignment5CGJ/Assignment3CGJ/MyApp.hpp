@@ -0,0 +1,246 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../mgl/mgl.hpp"
+#include "../mgl/mglSceneNode.hpp"
+#include "FileWatcher.hpp"
+#include "InstanceBatcher.hpp"
+#include "JobSystem.hpp"
+#include "LightGrid.hpp"
+#include "MeshLibrary.hpp"
+#include "MeshLoader.hpp"
+#include "OcclusionCuller.hpp"
+#include "Picker.hpp"
+#include "Pool.hpp"
+#include "Profiler.hpp"
+#include "RenderQueue.hpp"
+#include "Scene.hpp"
+#include "SceneFile.hpp"
+#include "ShaderPermutations.hpp"
+#include "ShadowMap.hpp"
+
+// The viewer: loads a scene, draws it and edits it with mouse and keys.
+// Implemented in main.cpp; the offline benchmarks drive it headless.
+class MyApp : public mgl::App {
+public:
+    void initCallback(GLFWwindow* win) override;
+    void displayCallback(GLFWwindow* win, double elapsed) override;
+    void windowSizeCallback(GLFWwindow* win, int width, int height) override;
+    void keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods) override;
+    void scrollCallback(GLFWwindow* win, double xoffset, double yoffset) override;
+    void mouseButtonCallback(GLFWwindow* win, int button, int action, int mods) override;
+    void cursorCallback(GLFWwindow* window, double xpos, double ypos) override;
+    void windowCloseCallback(GLFWwindow* win) override;
+
+    // Scene file loaded by initCallback (text .scene or binary .sbin).
+    void setScenePath(const std::string& path) { scenePath = path; }
+
+    // Heap allocations made by the last displayCallback().
+    uint64_t frameAllocations() const { return lastFrameAllocations; }
+
+    // Scripted camera control for the headless benchmark.
+    void setOrbit(float yaw, float pitch, float radius);
+    bool meshesLoading() const { return meshLoader.pending() > 0; }
+
+    // Light benchmark: `count` random lights around the scene centre, and
+    // the tile size used to bin them (0 for a single tile).
+    void setExtraLights(int count, unsigned seed);
+    void setLightTileSize(int pixels) { lightGrid.setTileSize(pixels); }
+    const LightGrid& lightList() const { return lightGrid; }
+
+    // Off for the benchmarks, which draw every frame they ask for.
+    void setOnDemand(bool enabled) { onDemand = enabled; }
+
+private:
+    // Camera control parameters
+    std::unique_ptr<mgl::Camera> Camera;
+    const float zoomSpeed = 1.0f;
+    const float minRadius = 2.0f;
+    const float maxRadius = 50.0f;
+    struct CameraInfo {
+        glm::mat4 viewMatrix;
+        glm::mat4 projectionMatrix;
+        glm::quat rotation;
+        float radius;
+        bool isOrtho;
+    };
+    CameraInfo cam1;
+    CameraInfo* activeCam = nullptr;
+    glm::vec3 target = glm::vec3(0.0f, 0.5f, 0.0f);
+
+    // Mouse control parameters
+    bool rightMousePressed = false;
+    bool leftMousePressed = false;
+    float panSpeed = 0.01f;
+    double lastCameraPosX = 0.0f;
+    double lastCameraPosY = 0.0f;
+    float rotationSpeed = 0.006f;
+    float pitchLimit = glm::radians(89.0f);
+
+    // Shader program: the active permutations of the forward and instanced
+    // shaders. Specular is toggled with H, the CPU normal matrix with N,
+    // tiled multi-light shading with L and the candle's shadows with K; the
+    // switch happens once the new variants are built, so activeFeatures may
+    // lag behind shadingFeatures.
+    const GLuint UBO_BP = 0;
+    enum ShadingFeature { SPECULAR = 1 << 0, NORMAL_MATRIX = 1 << 1, TILED_LIGHTS = 1 << 2, SHADOWS = 1 << 3 };
+    unsigned shadingFeatures = SPECULAR | NORMAL_MATRIX | TILED_LIGHTS | SHADOWS;
+    std::unique_ptr<ShaderPermutations> ShaderVariants;
+    std::unique_ptr<ShaderPermutations> InstancedShaderVariants;
+    mgl::ShaderProgram* Shaders = nullptr;
+    mgl::ShaderProgram* InstancedShaders = nullptr;
+    unsigned activeFeatures = 0;
+
+    // Uniforms set every frame, resolved once per variant
+    struct LightingUniforms {
+        GLint viewPos = -1;
+        GLint lightPos = -1;
+        GLint lightColor = -1;
+        LightGrid::Locations grid;
+        GLint shadowMap = -1;
+        GLint shadowRadius = -1;
+        GLint shadowLight = -1;
+    };
+    LightingUniforms ShaderUniforms;
+    LightingUniforms InstancedUniforms;
+    static LightingUniforms locateLighting(mgl::ShaderProgram* program);
+
+    // Model matrix uniform location
+    GLint ModelMatrixId;
+
+    // Instanced rendering (toggled with I); otherwise a state-sorted queue
+    InstanceBatcher batcher;
+    RenderQueue renderQueue;
+    bool instancing = true;
+
+    // View-frustum culling (toggled with C)
+    bool culling = true;
+
+    // Distance-based level of detail (toggled with O); error budget in pixels
+    bool levelOfDetail = true;
+    const float lodTolerance = 1.0f;
+
+    // Occlusion culling with asynchronous queries (toggled with Q)
+    OcclusionCuller occlusionCuller;
+    bool occlusion = true;
+
+    // Lights: one above every candle, plus any added by the light benchmark;
+    // binned into screen tiles every frame
+    LightGrid lightGrid;
+    std::vector<mgl::SceneNode*> candleNodes;
+    std::vector<PointLight> lights;
+    std::vector<PointLight> extraLights;
+    const float candleRadius = 12.0f;
+    int viewportWidth = 800;
+    int viewportHeight = 600;
+
+    // Shadows of the VELA candle's light; its static casters are cached and
+    // only drawn again when one of them is edited
+    ShadowMap shadowMap;
+
+    // Asynchronous mesh loading; uploads are limited per frame
+    MeshLoader meshLoader;
+    const size_t uploadBudget = 4 * 1024 * 1024;
+    std::chrono::steady_clock::time_point loadStart;
+
+    // Meshes, shared by path; the scene holds a handle to each one it uses,
+    // and meshes no scene uses are freed after a reload (F5)
+    MeshLibrary meshLibrary{ meshLoader };
+    std::vector<MeshLibrary::Handle> sceneMeshes;  // indexed like sceneDesc.meshes
+
+    // Hot reload: the scene's meshes and the shader sources are watched. A
+    // changed mesh is imported again on the loader pool and uploaded into the
+    // same MeshBuffers; a changed shader is rebuilt (ShaderPermutations::
+    // reload) and relinked into the same programs. Both swap in at the start
+    // of a frame, so no node needs rebuilding. While idle, on-demand
+    // rendering notices a change within idleRedraw.
+    FileWatcher watcher;
+    std::vector<std::string> changedFiles;
+    std::chrono::steady_clock::time_point shaderReloadStart;
+
+    // Scene Graph
+    // Nodes live in a pool: allocated in blocks, addresses never move, and
+    // the blocks are reused by the next scene.
+    std::string scenePath = "default.scene";
+    const std::string editedScenePath = "edited.scene";
+    SceneDesc sceneDesc;
+    Pool<mgl::SceneNode> sceneNodes;
+    mgl::SceneNode* candleNode = nullptr;
+    Scene scene;
+
+    // Parallel scene update and traversal (toggled with J)
+    JobSystem jobs;
+    bool parallel = true;
+
+    // Per-second report of how many world matrices were recomputed
+    double statsTime = 0.0;
+    int statsFrames = 0;
+    int statsRecomputed = 0;
+    uint64_t statsAllocations = 0;
+    int statsShadowRenders = 0;
+    uint64_t lastFrameAllocations = 0;
+    bool closing = false;
+
+    // Picking
+    Picker picker;
+
+    // Profiling: rolling timings printed with T, written to CSV on close
+    Profiler profiler;
+    struct ProfileSections {
+        int update, lights, traversal, submit, picking, upload, gpuScene, gpuShadows, drawCalls, triangles,
+            lightsPerTile, occludedDraws, occludedTriangles, shadowFaces, shadowCasters, heapAllocations;
+    } prof;
+    bool showProfile = false;
+    const std::string profileCsv = "profile.csv";
+
+    // On-demand rendering (toggled with F): displayCallback waits in the
+    // event loop until input, a scene or camera change, or mesh streaming
+    // needs a frame. A change is drawn for a few frames, until the occlusion
+    // queries it triggered have come back; while idle a frame is still drawn
+    // every idleRedraw seconds, in case the window contents were lost.
+    bool onDemand = true;
+    int redrawFrames = 1;
+    const int settleFrames = OcclusionCuller::VISIBLE_INTERVAL + 2;
+    const double idleRedraw = 1.0;
+    double waited = 0.0;
+    void requestRedraw() { redrawFrames = std::max(redrawFrames, settleFrames); }
+    double waitForRedraw(GLFWwindow* win);
+
+    // Modos de Edio
+    enum OpMode { NONE, TRANSLATE, ROTATE, SCALE };
+    enum Axis { AXIS_X, AXIS_Y, AXIS_Z };
+
+    OpMode currentMode = NONE;      // Comea sem fazer nada
+    Axis currentAxis = AXIS_X;      // Eixo default
+    mgl::SceneNode* selectedNode = nullptr; // Quem est selecionado?
+
+    // Rato
+    bool isDragging = false;
+    double lastMouseX = 0.0;
+    double lastMouseY = 0.0;
+
+    bool createMeshes();
+    void createShaderPrograms();
+    static void addLightGridUniforms(mgl::ShaderProgram* program);
+    static void addShadowUniforms(mgl::ShaderProgram* program);
+    void selectShaders();
+    void locateUniforms();
+    void createCamera();
+    void drawScene();
+    void uploadLighting(mgl::ShaderProgram* program, const LightingUniforms& uniforms, const glm::vec3& viewPos,
+        const glm::vec3& lightPos, int shadowLight);
+    void updateCamera();
+    glm::mat4 getModel(glm::vec3 pos, float rotX, float rotY, float rotZ, float scal);
+    void drawMesh(mgl::Mesh* m, glm::vec3 pos, float rotX, float rotY, float rotZ, float scal);
+    void createSceneGraph();
+    void reloadScene();
+    void watchAssets();
+    void reloadAsset(const std::string& path);
+    void releaseResources();
+    void saveScene();
+    static void calculateProjection(CameraInfo& cam, int width, int height);
+    mgl::SceneNode* pickObject(GLFWwindow* win, double mouseX, double mouseY);
+};
@@ -0,0 +1,160 @@
+#include "OcclusionCuller.hpp"
+
+OcclusionCuller::~OcclusionCuller() {
+    release();
+}
+
+void OcclusionCuller::release() {
+    for (auto& s : states_) {
+        if (s.second.query) glDeleteQueries(1, &s.second.query);
+    }
+    states_.clear();
+    if (vaoId_) {
+        glDeleteVertexArrays(1, &vaoId_);
+        glDeleteBuffers(2, vboId_);
+    }
+    vaoId_ = 0;
+    vboId_[0] = vboId_[1] = 0;
+    delete program_;
+    program_ = nullptr;
+}
+
+void OcclusionCuller::create() {
+    release();
+    program_ = new mgl::ShaderProgram();
+    program_->addShader(GL_VERTEX_SHADER, "occlusion-vs.glsl");
+    program_->addShader(GL_FRAGMENT_SHADER, "occlusion-fs.glsl");
+    program_->addAttribute(mgl::POSITION_ATTRIBUTE, mgl::Mesh::POSITION);
+    program_->addUniform("BoxMatrix");
+    program_->create();
+    boxMatrixId_ = program_->Uniforms["BoxMatrix"].index;
+
+    // Unit cube, corner i at (i & 1, i & 2, i & 4).
+    GLfloat corners[8 * 3];
+    for (int i = 0; i < 8; i++) {
+        corners[3 * i] = (GLfloat)(i & 1);
+        corners[3 * i + 1] = (GLfloat)((i >> 1) & 1);
+        corners[3 * i + 2] = (GLfloat)((i >> 2) & 1);
+    }
+    const GLubyte indices[36] = {
+        0, 2, 1, 1, 2, 3,   4, 5, 6, 5, 7, 6,   0, 1, 4, 1, 5, 4,
+        2, 6, 3, 3, 6, 7,   0, 4, 2, 2, 4, 6,   1, 3, 5, 3, 7, 5,
+    };
+
+    glGenVertexArrays(1, &vaoId_);
+    glBindVertexArray(vaoId_);
+    {
+        glGenBuffers(2, vboId_);
+        glBindBuffer(GL_ARRAY_BUFFER, vboId_[0]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(mgl::Mesh::POSITION);
+        glVertexAttribPointer(mgl::Mesh::POSITION, 3, GL_FLOAT, GL_FALSE, 0, 0);
+
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vboId_[1]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void OcclusionCuller::update(Scene& scene) {
+    pending_ = 0;
+    for (auto it = states_.begin(); it != states_.end();) {
+        NodeState& state = it->second;
+        int index = scene.indexOf(it->first);
+        if (index < 0) {
+            if (state.query) glDeleteQueries(1, &state.query);
+            it = states_.erase(it);
+            continue;
+        }
+        if (state.pending) {
+            GLuint available = 0;
+            glGetQueryObjectuiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint passed = 0;
+                glGetQueryObjectuiv(state.query, GL_QUERY_RESULT, &passed);
+                scene.setOccluded(index, passed == 0);
+                state.pending = false;
+            }
+            else {
+                pending_++;
+            }
+        }
+        ++it;
+    }
+}
+
+// A box that reaches behind the near plane is clipped and may pass no
+// samples although the node is visible.
+static bool crossesNearPlane(const AABB& box, const glm::mat4& viewProjection) {
+    for (int i = 0; i < 8; i++) {
+        glm::vec3 corner(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y,
+            i & 4 ? box.max.z : box.min.z);
+        glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+        if (clip.w <= 0.0f || clip.z < -clip.w) return true;
+    }
+    return false;
+}
+
+void OcclusionCuller::issue(Scene& scene, const glm::mat4& viewProjection) {
+    frame_++;
+    issued_ = 0;
+    if (!program_) return;
+
+    bool stateSet = false;
+    GLboolean cullFace = GL_FALSE;
+    for (int index : scene.inFrustum()) {
+        NodeState& state = states_[scene.node(index)];
+        if (state.pending) continue;
+        // Visible nodes take turns, spread over the frames by index.
+        if (!scene.occluded(index) && (frame_ + index) % VISIBLE_INTERVAL != 0) continue;
+
+        // Grown a little so flat meshes still cover pixels.
+        AABB box = scene.meshBounds(index);
+        glm::vec3 margin = box.extent() * 0.01f + glm::vec3(1e-3f);
+        box.min -= margin;
+        box.max += margin;
+        if (crossesNearPlane(box, viewProjection)) {
+            scene.setOccluded(index, false);
+            continue;
+        }
+
+        if (!stateSet) {
+            cullFace = glIsEnabled(GL_CULL_FACE);
+            glDisable(GL_CULL_FACE);
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            glDepthMask(GL_FALSE);
+            program_->bind();
+            glBindVertexArray(vaoId_);
+            stateSet = true;
+        }
+        if (!state.query) glGenQueries(1, &state.query);
+
+        glm::mat4 placement = glm::translate(glm::mat4(1.0f), box.min) * glm::scale(glm::mat4(1.0f), box.extent());
+        glm::mat4 boxMatrix = viewProjection * placement;
+        glUniformMatrix4fv(boxMatrixId_, 1, GL_FALSE, glm::value_ptr(boxMatrix));
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, 0);
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        state.pending = true;
+        issued_++;
+    }
+
+    if (stateSet) {
+        glBindVertexArray(0);
+        program_->unbind();
+        glDepthMask(GL_TRUE);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        if (cullFace) glEnable(GL_CULL_FACE);
+    }
+}
+
+void OcclusionCuller::reset(Scene& scene) {
+    for (auto& s : states_) {
+        if (s.second.query) glDeleteQueries(1, &s.second.query);
+    }
+    states_.clear();
+    scene.clearOccluded();
+    pending_ = 0;
+}
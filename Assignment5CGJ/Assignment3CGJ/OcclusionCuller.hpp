@@ -0,0 +1,58 @@
+#pragma once
+#include <unordered_map>
+#include "../mgl/mgl.hpp"
+#include "../mgl/mglSceneNode.hpp"
+#include "Scene.hpp"
+
+// Occlusion culling with asynchronous hardware queries. After the visible
+// draws of a frame, issue() draws the world bounding box of every node that
+// was inside the frustum, depth-tested but without writing colour or depth,
+// inside a GL_ANY_SAMPLES_PASSED query. update() reads back the queries that
+// have finished, at the start of a later frame, and marks nodes whose box
+// passed no samples as occluded in the Scene; results that are not ready
+// yet leave the node as it was. The CPU never waits for the GPU, at the
+// price of hidden nodes reappearing a frame or two late.
+//
+// Occluded nodes are queried every frame so they come back promptly;
+// visible ones only every VISIBLE_INTERVAL frames.
+class OcclusionCuller {
+public:
+    static const unsigned VISIBLE_INTERVAL = 4;
+
+    ~OcclusionCuller();
+
+    // Loads the box shader; call with a current context.
+    void create();
+
+    // Applies the query results that have arrived.
+    void update(Scene& scene);
+
+    // Queries the nodes the last Scene::draw() found inside the frustum.
+    // Call once the depth buffer holds the frame's visible draws.
+    void issue(Scene& scene, const glm::mat4& viewProjection);
+
+    // Forgets every result and shows every node again.
+    void reset(Scene& scene);
+
+    // Frees the queries and the box shader; create() makes them again.
+    void release();
+
+    // Queries issued by the last issue() and still outstanding.
+    int issuedCount() const { return issued_; }
+    int pendingCount() const { return pending_; }
+
+private:
+    struct NodeState {
+        GLuint query = 0;
+        bool pending = false;
+    };
+
+    std::unordered_map<const mgl::SceneNode*, NodeState> states_;
+    mgl::ShaderProgram* program_ = nullptr;
+    GLint boxMatrixId_ = -1;
+    GLuint vaoId_ = 0;
+    GLuint vboId_[2] = { 0, 0 };
+    unsigned frame_ = 0;
+    int issued_ = 0;
+    int pending_ = 0;
+};
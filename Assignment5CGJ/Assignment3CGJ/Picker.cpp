@@ -0,0 +1,71 @@
+#include "Picker.hpp"
+
+void Picker::add(mgl::SceneNode* node, const MeshBVH* bvh, const std::string& name) {
+    lookup_[node] = entries_.size();
+    entries_.push_back({ node, bvh, name });
+}
+
+void Picker::clear() {
+    entries_.clear();
+    lookup_.clear();
+}
+
+int Picker::indexOf(const mgl::SceneNode* node) const {
+    auto it = lookup_.find(node);
+    return it == lookup_.end() ? -1 : (int)it->second;
+}
+
+Ray Picker::cursorRay(double mouseX, double mouseY, int width, int height,
+    const glm::mat4& view, const glm::mat4& projection) {
+    float x = 2.0f * (float)mouseX / (float)width - 1.0f;
+    float y = 1.0f - 2.0f * (float)mouseY / (float)height;
+
+    // Unprojecting both clip planes works for perspective and ortho alike.
+    glm::mat4 invViewProj = glm::inverse(projection * view);
+    glm::vec4 nearPoint = invViewProj * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = invViewProj * glm::vec4(x, y, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 target = glm::vec3(farPoint) / farPoint.w;
+    return Ray(origin, glm::normalize(target - origin));
+}
+
+mgl::SceneNode* Picker::pick(const Scene& scene, double mouseX, double mouseY, int width, int height,
+    const glm::mat4& view, const glm::mat4& projection, float* distance) const {
+    if (width <= 0 || height <= 0) return nullptr;
+
+    Ray ray = cursorRay(mouseX, mouseY, width, height, view, projection);
+    mgl::SceneNode* nearest = nullptr;
+    float tNearest = std::numeric_limits<float>::max();
+
+    std::vector<SpatialIndex::RayHit> candidates;
+    scene.spatialIndex().raycast(ray, tNearest, candidates);
+    for (const SpatialIndex::RayHit& candidate : candidates) {
+        // Nothing further on can be nearer than the hit already found.
+        if (candidate.distance > tNearest) break;
+        int i = indexOf(scene.node(candidate.data));
+        if (i < 0) continue;
+        const Entry& e = entries_[i];
+        if (!e.bvh || e.bvh->empty()) continue;
+
+        // The direction is left unnormalised in mesh space so that hit
+        // distances stay comparable with the world-space ray.
+        glm::mat4 toLocal = glm::inverse(scene.worldTransform(e.node));
+        Ray local(glm::vec3(toLocal * glm::vec4(ray.origin, 1.0f)),
+            glm::vec3(toLocal * glm::vec4(ray.direction, 0.0f)));
+
+        float t = tNearest;
+        if (e.bvh->intersect(local, t)) {
+            tNearest = t;
+            nearest = e.node;
+        }
+    }
+
+    if (distance && nearest) *distance = tNearest;
+    return nearest;
+}
+
+const std::string& Picker::nameOf(const mgl::SceneNode* node) const {
+    static const std::string none = "NADA";
+    int i = indexOf(node);
+    return i < 0 ? none : entries_[i].name;
+}
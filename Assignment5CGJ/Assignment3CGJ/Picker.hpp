@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../mgl/mgl.hpp"
+#include "../mgl/mglSceneNode.hpp"
+#include "MeshBVH.hpp"
+#include "Scene.hpp"
+
+// CPU picking: casts a ray from the cursor through the camera matrices and
+// tests it against the BVH of each registered node whose bounds the ray
+// enters, nearest first (Scene::spatialIndex()). No GPU round-trip.
+class Picker {
+public:
+    void add(mgl::SceneNode* node, const MeshBVH* bvh, const std::string& name);
+    void clear();
+
+    // Nearest node under the cursor, or nullptr. Mouse coords in window pixels;
+    // world matrices come from the scene's cache.
+    mgl::SceneNode* pick(const Scene& scene, double mouseX, double mouseY, int width, int height,
+        const glm::mat4& view, const glm::mat4& projection, float* distance = nullptr) const;
+
+    const std::string& nameOf(const mgl::SceneNode* node) const;
+
+    static Ray cursorRay(double mouseX, double mouseY, int width, int height,
+        const glm::mat4& view, const glm::mat4& projection);
+
+private:
+    struct Entry {
+        mgl::SceneNode* node;
+        const MeshBVH* bvh;
+        std::string name;
+    };
+    std::vector<Entry> entries_;
+    std::unordered_map<const mgl::SceneNode*, size_t> lookup_;
+
+    int indexOf(const mgl::SceneNode* node) const;
+};
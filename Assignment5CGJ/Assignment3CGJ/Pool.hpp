@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Arena for objects of one type, allocated in blocks of BLOCK_SIZE. Objects
+// never move and are numbered in creation order. clear() destroys them all
+// at once but keeps the blocks, so rebuilding a scene of the same size
+// makes no heap allocations; for trivially destructible types it does not
+// touch the objects at all. Individual objects cannot be freed.
+template <typename T, size_t BLOCK_SIZE = 1024>
+class Pool {
+public:
+    Pool() = default;
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+    ~Pool() { clear(); }
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        size_t block = size_ / BLOCK_SIZE;
+        if (block == blocks_.size()) blocks_.emplace_back(new Storage[BLOCK_SIZE]);
+        T* object = new (&blocks_[block][size_ % BLOCK_SIZE]) T(std::forward<Args>(args)...);
+        size_++;
+        return object;
+    }
+
+    void clear() {
+        if (!std::is_trivially_destructible<T>::value) {
+            for (size_t i = size_; i-- > 0;) (*this)[i].~T();
+        }
+        size_ = 0;
+    }
+
+    // Returns the blocks to the heap as well.
+    void release() {
+        clear();
+        blocks_.clear();
+    }
+
+    T& operator[](size_t index) { return *reinterpret_cast<T*>(&blocks_[index / BLOCK_SIZE][index % BLOCK_SIZE]); }
+    const T& operator[](size_t index) const {
+        return *reinterpret_cast<const T*>(&blocks_[index / BLOCK_SIZE][index % BLOCK_SIZE]);
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return blocks_.size() * BLOCK_SIZE; }
+
+private:
+    struct alignas(T) Storage {
+        unsigned char bytes[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Storage[]>> blocks_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,153 @@
+#include "Profiler.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+Profiler::~Profiler() {
+    for (Section& s : sections_) {
+        if (s.kind == GPU && s.queries[0]) glDeleteQueries(QUERY_FRAMES, s.queries);
+    }
+}
+
+int Profiler::section(const std::string& name, Kind kind) {
+    for (size_t i = 0; i < sections_.size(); i++) {
+        if (sections_[i].name == name) return (int)i;
+    }
+    Section s;
+    s.name = name;
+    s.kind = kind;
+    s.samples.reserve(WINDOW);
+    sections_.push_back(s);
+    return (int)sections_.size() - 1;
+}
+
+int Profiler::cpuSection(const std::string& name) {
+    return section(name, CPU);
+}
+
+int Profiler::gpuSection(const std::string& name) {
+    int id = section(name, GPU);
+    if (!sections_[id].queries[0]) glGenQueries(QUERY_FRAMES, sections_[id].queries);
+    return id;
+}
+
+int Profiler::counter(const std::string& name) {
+    return section(name, COUNTER);
+}
+
+void Profiler::record(Section& s, double value) {
+    if (s.samples.size() < WINDOW) {
+        s.samples.push_back((float)value);
+    }
+    else {
+        s.samples[s.next] = (float)value;
+    }
+    s.next = (s.next + 1) % WINDOW;
+}
+
+void Profiler::collectQueries() {
+    for (Section& s : sections_) {
+        if (s.kind != GPU) continue;
+        for (int i = 0; i < QUERY_FRAMES; i++) {
+            if (!s.pending[i]) continue;
+            GLint available = 0;
+            glGetQueryObjectiv(s.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) continue;
+            GLuint64 ns = 0;
+            glGetQueryObjectui64v(s.queries[i], GL_QUERY_RESULT, &ns);
+            s.pending[i] = false;
+            record(s, ns * 1e-6);
+        }
+    }
+}
+
+void Profiler::beginFrame() {
+    frame_++;
+    collectQueries();
+}
+
+// CPU sections and counters may run several times per frame, or between
+// frames (picking runs in the input callbacks); they contribute one summed
+// sample per frame in which they ran.
+void Profiler::endFrame(double elapsed) {
+    for (Section& s : sections_) {
+        if (s.kind == GPU || !s.touched) continue;
+        record(s, s.accumulated);
+        s.accumulated = 0.0;
+        s.touched = false;
+    }
+    if (frameTime_ < 0) frameTime_ = section("frame", CPU);
+    record(sections_[frameTime_], elapsed * 1000.0);
+}
+
+void Profiler::begin(int id) {
+    Section& s = sections_[id];
+    if (s.kind == GPU) {
+        // A query still unread after QUERY_FRAMES frames is dropped, not waited on.
+        int slot = frame_ % QUERY_FRAMES;
+        glBeginQuery(GL_TIME_ELAPSED, s.queries[slot]);
+        s.pending[slot] = false;
+    }
+    else {
+        s.start = std::chrono::steady_clock::now();
+    }
+}
+
+void Profiler::end(int id) {
+    Section& s = sections_[id];
+    if (s.kind == GPU) {
+        glEndQuery(GL_TIME_ELAPSED);
+        s.pending[frame_ % QUERY_FRAMES] = true;
+    }
+    else {
+        s.accumulated += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s.start).count();
+        s.touched = true;
+    }
+}
+
+void Profiler::add(int id, double value) {
+    sections_[id].accumulated += value;
+    sections_[id].touched = true;
+}
+
+Profiler::Summary Profiler::summary(int id) const {
+    Summary r;
+    const std::vector<float>& samples = sections_[id].samples;
+    if (samples.empty()) return r;
+
+    std::vector<float> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (float v : sorted) sum += v;
+    r.samples = sorted.size();
+    r.min = sorted.front();
+    r.avg = sum / sorted.size();
+    r.p99 = sorted[std::min(sorted.size() - 1, (size_t)(0.99 * sorted.size()))];
+    return r;
+}
+
+void Profiler::report(std::ostream& out) const {
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < sections_.size(); i++) {
+        Summary s = summary((int)i);
+        if (s.samples == 0) continue;
+        const char* unit = sections_[i].kind == COUNTER ? "" : " ms";
+        out << "  " << std::left << std::setw(12) << sections_[i].name << std::right
+            << " min " << s.min << unit << "  avg " << s.avg << unit << "  p99 " << s.p99 << unit << std::endl;
+    }
+    out.flags(flags);
+}
+
+bool Profiler::writeCsv(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "section,kind,min,avg,p99,samples\n";
+    for (size_t i = 0; i < sections_.size(); i++) {
+        static const char* kinds[] = { "cpu_ms", "gpu_ms", "count" };
+        Summary s = summary((int)i);
+        out << sections_[i].name << "," << kinds[sections_[i].kind] << "," << s.min << "," << s.avg << ","
+            << s.p99 << "," << s.samples << "\n";
+    }
+    return true;
+}
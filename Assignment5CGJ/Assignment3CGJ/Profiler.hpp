@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+// Per-frame instrumentation: CPU sections timed with steady_clock, GPU
+// sections timed with GL_TIME_ELAPSED queries, and plain counters (draw
+// calls, triangles). GPU results are read QUERY_FRAMES frames later and
+// only when already available, so the profiler never stalls the pipeline.
+// Every section keeps the last WINDOW samples for min/avg/p99.
+class Profiler {
+public:
+    static const size_t WINDOW = 300;
+    static const int QUERY_FRAMES = 3;
+
+    struct Summary {
+        double min = 0.0;
+        double avg = 0.0;
+        double p99 = 0.0;
+        size_t samples = 0;
+    };
+
+    // Times a CPU section for as long as it is in scope.
+    class Scope {
+    public:
+        Scope(Profiler& profiler, int section) : profiler_(profiler), section_(section) { profiler_.begin(section_); }
+        ~Scope() { profiler_.end(section_); }
+    private:
+        Profiler& profiler_;
+        int section_;
+    };
+
+    ~Profiler();
+
+    // Section ids are stable; look them up once and keep them.
+    int cpuSection(const std::string& name);
+    int gpuSection(const std::string& name);
+    int counter(const std::string& name);
+
+    void beginFrame();
+    void endFrame(double elapsed);
+
+    void begin(int section);
+    void end(int section);
+    void add(int counter, double value);
+
+    Summary summary(int section) const;
+    void report(std::ostream& out) const;
+    bool writeCsv(const std::string& path) const;
+
+private:
+    enum Kind { CPU, GPU, COUNTER };
+
+    struct Section {
+        std::string name;
+        Kind kind;
+        std::vector<float> samples;
+        size_t next = 0;
+        std::chrono::steady_clock::time_point start;
+        double accumulated = 0.0;
+        bool touched = false;
+        GLuint queries[QUERY_FRAMES] = {};
+        bool pending[QUERY_FRAMES] = {};
+    };
+
+    std::vector<Section> sections_;
+    int frameTime_ = -1;
+    unsigned frame_ = 0;
+
+    int section(const std::string& name, Kind kind);
+    void record(Section& s, double value);
+    void collectQueries();
+};
@@ -0,0 +1,124 @@
+#include "RenderQueue.hpp"
+#include <algorithm>
+#include <tuple>
+#include "InstanceBatcher.hpp"
+
+void RenderQueue::addVariant(mgl::ShaderProgram* shader, mgl::ShaderProgram* instanced) {
+    for (const auto& v : variants_) {
+        if (v.first == shader) return;
+    }
+    variants_.push_back({ shader, instanced });
+    for (ShaderBinding& b : bindings_) {
+        if (b.shader == shader) b.instanced = instanced;
+    }
+}
+
+uint32_t RenderQueue::bindingOf(mgl::ShaderProgram* shader) {
+    for (uint32_t i = 0; i < bindings_.size(); i++) {
+        if (bindings_[i].shader == shader) return i;
+    }
+    ShaderBinding b;
+    b.shader = shader;
+    b.instanced = nullptr;
+    for (const auto& v : variants_) {
+        if (v.first == shader) b.instanced = v.second;
+    }
+    b.modelMatrix = shader->isUniform(mgl::MODEL_MATRIX) ? shader->Uniforms[mgl::MODEL_MATRIX].index : -1;
+    b.normalMatrix = shader->isUniform("NormalMatrix") ? shader->Uniforms["NormalMatrix"].index : -1;
+    b.color = shader->isUniform("uColor") ? shader->Uniforms["uColor"].index : -1;
+    bindings_.push_back(b);
+    return (uint32_t)bindings_.size() - 1;
+}
+
+void RenderQueue::add(const MeshBuffers* mesh, unsigned level, mgl::ShaderProgram* shader, const glm::mat4& world,
+    const glm::mat3& normal, const glm::vec4& color) {
+    items_.push_back({ bindingOf(shader), mesh->vao(), color, mesh, level, world, normal });
+}
+
+void RenderQueue::flush() {
+    stats_ = Stats();
+    if (items_.empty()) return;
+
+    // Sort indices rather than the items themselves, which carry a matrix.
+    // Instanced draws read their colour from the record, so only the others
+    // sort by it.
+    order_.resize(items_.size());
+    for (uint32_t i = 0; i < order_.size(); i++) order_[i] = i;
+    std::sort(order_.begin(), order_.end(), [this](uint32_t a, uint32_t b) {
+        const Item& x = items_[a];
+        const Item& y = items_[b];
+        if (x.binding != y.binding || x.vao != y.vao) return std::tie(x.binding, x.vao) < std::tie(y.binding, y.vao);
+        if (bindings_[x.binding].instanced) return x.level < y.level;
+        return std::tie(x.color.r, x.color.g, x.color.b) < std::tie(y.color.r, y.color.g, y.color.b);
+    });
+
+    // One record per draw, in draw order, so the k-th draw is instance k.
+    typedef InstanceBatcher::Instance Record;
+    Record* records = static_cast<Record*>(stream_.begin(order_.size() * sizeof(Record)));
+    for (uint32_t index : order_) {
+        const Item& item = items_[index];
+        *records++ = { item.world, item.color, item.normal };
+    }
+    size_t offset = stream_.end();
+
+    uint32_t boundBinding = UINT32_MAX;
+    GLuint boundVao = 0;
+    bool attributesValid = false;
+    glm::vec3 boundColor;
+    bool colorValid = false;
+    int normalDraws = 0;
+
+    for (uint32_t k = 0; k < order_.size(); k++) {
+        const Item& item = items_[order_[k]];
+        const ShaderBinding& binding = bindings_[item.binding];
+
+        if (item.binding != boundBinding) {
+            boundBinding = item.binding;
+            (binding.instanced ? binding.instanced : binding.shader)->bind();
+            colorValid = false;
+            stats_.programBinds++;
+        }
+        if (item.vao != boundVao) {
+            boundVao = item.vao;
+            item.mesh->bindVertexArray();
+            attributesValid = false;
+            stats_.vaoBinds++;
+        }
+
+        if (binding.instanced) {
+            // Attribute pointers are VAO state: set once per VAO per flush.
+            if (!attributesValid) {
+                InstanceBatcher::bindAttributes(stream_.buffer(), offset);
+                attributesValid = true;
+            }
+            item.mesh->drawElementsInstanced(1, k, item.level);
+            normalDraws++;
+        }
+        else {
+            glm::vec3 color(item.color);
+            if (binding.color >= 0 && (!colorValid || color != boundColor)) {
+                glUniform3fv(binding.color, 1, glm::value_ptr(color));
+                boundColor = color;
+                colorValid = true;
+                stats_.uniformUploads++;
+            }
+            glUniformMatrix4fv(binding.modelMatrix, 1, GL_FALSE, glm::value_ptr(item.world));
+            stats_.uniformUploads++;
+            if (binding.normalMatrix >= 0) {
+                glUniformMatrix3fv(binding.normalMatrix, 1, GL_FALSE, glm::value_ptr(item.normal));
+                stats_.uniformUploads++;
+                normalDraws++;
+            }
+            item.mesh->drawElements(item.level);
+        }
+        stats_.draws++;
+        stats_.triangles += item.mesh->indexCount(item.level) / 3;
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    stream_.fence();
+
+    // Per draw: program bind, VAO bind and unbind, colour and matrix uploads.
+    stats_.unsortedStateChanges = 5 * stats_.draws + normalDraws;
+    items_.clear();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "DrawSink.hpp"
+#include "StreamBuffer.hpp"
+
+// Collects draws during traversal and issues them sorted by shader, VAO and
+// colour (level of detail for instanced draws, which take their colour from
+// the instance record), so consecutive draws share as much GL state as
+// possible. Program,
+// VAO and colour changes are only issued when they differ from what is
+// bound; uniform locations are resolved once per program.
+//
+// Shaders with an instanced variant take no per-draw uniforms: every draw's
+// matrices and colour are written once per flush into a StreamBuffer, and
+// each draw picks its record with baseInstance.
+class RenderQueue : public IDrawSink {
+public:
+    // GL calls issued by the last flush(), and what issuing every draw with
+    // its own bind/unbind and uniform lookups would have cost.
+    struct Stats {
+        int draws = 0;
+        int triangles = 0;
+        int programBinds = 0;
+        int vaoBinds = 0;
+        int uniformUploads = 0;
+        int unsortedStateChanges = 0;
+
+        int stateChanges() const { return programBinds + vaoBinds + uniformUploads; }
+    };
+
+    void add(const MeshBuffers* mesh, unsigned level, mgl::ShaderProgram* shader, const glm::mat4& world,
+        const glm::mat3& normal, const glm::vec4& color) override;
+    void flush();
+
+    // Program that reads per-draw data as InstanceBatcher instance attributes,
+    // used in place of `shader`. A shader that already has one keeps it.
+    void addVariant(mgl::ShaderProgram* shader, mgl::ShaderProgram* instanced);
+
+    // Resolves the uniform locations again on the next add(); call between
+    // frames when programs were relinked in place.
+    void resetBindings() { bindings_.clear(); }
+
+    const Stats& stats() const { return stats_; }
+    int streamWaits() const { return stream_.waitCount(); }
+
+private:
+    struct ShaderBinding {
+        mgl::ShaderProgram* shader;
+        mgl::ShaderProgram* instanced;
+        GLint modelMatrix;
+        GLint normalMatrix;     // -1 for variants that derive it per vertex
+        GLint color;
+    };
+
+    struct Item {
+        uint32_t binding;
+        GLuint vao;
+        glm::vec4 color;
+        const MeshBuffers* mesh;
+        unsigned level;
+        glm::mat4 world;
+        glm::mat3 normal;
+    };
+
+    std::vector<ShaderBinding> bindings_;
+    std::vector<Item> items_;
+    std::vector<uint32_t> order_;
+    std::vector<std::pair<mgl::ShaderProgram*, mgl::ShaderProgram*>> variants_;
+    StreamBuffer stream_;
+    Stats stats_;
+
+    uint32_t bindingOf(mgl::ShaderProgram* shader);
+};
@@ -0,0 +1,590 @@
+#include "Scene.hpp"
+#include "TransformBatch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+// A node only switches to a coarser level once its error is this fraction of
+// the tolerance, so it does not flicker between two levels at the threshold.
+static const float LOD_HYSTERESIS = 0.75f;
+
+// Once dirty subtrees hold more than this share of the nodes, update()
+// redoes every node (spread over the job system) instead.
+static const float FULL_UPDATE_SHARE = 0.25f;
+
+uint32_t Scene::materialOf(const glm::vec4& color, mgl::ShaderProgram* shader) {
+    auto key = std::make_tuple(shader, color.r, color.g, color.b, color.a);
+    auto it = materialIds_.find(key);
+    if (it != materialIds_.end()) return it->second;
+    uint32_t id = (uint32_t)materials_.size();
+    materials_.push_back({ color, shader });
+    materialIds_.emplace(key, id);
+    return id;
+}
+
+int Scene::add(mgl::SceneNode* node, mgl::SceneNode* parent, const MeshBuffers* mesh, const glm::vec4& color,
+    mgl::ShaderProgram* shader) {
+    int index = (int)nodes_.size();
+    int parentIndex = indexOf(parent);
+
+    nodes_.push_back(node);
+    parent_.push_back(parentIndex);
+    subtreeSize_.push_back(1);
+    meshCount_.push_back(0);
+    mesh_.push_back(shader ? mesh : nullptr);
+    material_.push_back(materialOf(color, shader));
+    local_.push_back(node->transform);
+    world_.push_back(glm::mat4(1.0f));
+    normal_.push_back(glm::mat3(1.0f));
+    meshBounds_.push_back(AABB());
+    sphere_.push_back(Sphere());
+    bounds_.push_back(AABB());
+    dirty_.push_back(0);
+    lod_.push_back(0);
+    occluded_.push_back(0);
+    edited_.push_back(0);
+    proxy_.push_back(-1);
+    index_[node] = index;
+
+    // Appending breaks depth-first order unless the parent is the last
+    // subtree; relayout() on the next update() restores it.
+    layoutDirty_ = true;
+    markDirty(index);
+    return index;
+}
+
+void Scene::clear() {
+    nodes_.clear();
+    parent_.clear();
+    subtreeSize_.clear();
+    meshCount_.clear();
+    mesh_.clear();
+    material_.clear();
+    local_.clear();
+    world_.clear();
+    normal_.clear();
+    meshBounds_.clear();
+    sphere_.clear();
+    bounds_.clear();
+    dirty_.clear();
+    lod_.clear();
+    occluded_.clear();
+    edited_.clear();
+    proxy_.clear();
+    spatial_.clear();
+    inFrustum_.clear();
+    materials_.clear();
+    materialIds_.clear();
+    index_.clear();
+    edits_.clear();
+    ranges_.clear();
+    spine_.clear();
+    tops_.clear();
+    dirtyRoots_.clear();
+    allDirty_ = false;
+    layoutDirty_ = false;
+    recomputed_ = 0;
+}
+
+void Scene::reserve(size_t count) {
+    nodes_.reserve(count);
+    parent_.reserve(count);
+    subtreeSize_.reserve(count);
+    meshCount_.reserve(count);
+    mesh_.reserve(count);
+    material_.reserve(count);
+    local_.reserve(count);
+    world_.reserve(count);
+    normal_.reserve(count);
+    meshBounds_.reserve(count);
+    sphere_.reserve(count);
+    bounds_.reserve(count);
+    dirty_.reserve(count);
+    lod_.reserve(count);
+    occluded_.reserve(count);
+    edited_.reserve(count);
+    proxy_.reserve(count);
+    index_.reserve(count);
+}
+
+int Scene::indexOf(const mgl::SceneNode* node) const {
+    if (!node) return -1;
+    auto it = index_.find(node);
+    return it == index_.end() ? -1 : it->second;
+}
+
+void Scene::setLocalTransform(mgl::SceneNode* node, const glm::mat4& local) {
+    node->setTransform(local);
+    int index = indexOf(node);
+    if (index < 0) return;
+    local_[index] = local;
+    markDirty(index);
+    // A drag sets the same node many times a frame.
+    if (!edited_[index]) {
+        edited_[index] = 1;
+        edits_.push_back(node);
+    }
+}
+
+void Scene::takeEdits(std::vector<const mgl::SceneNode*>& edits) {
+    edits.clear();
+    edits.swap(edits_);
+    for (const mgl::SceneNode* node : edits) edited_[indexOf(node)] = 0;
+}
+
+const glm::mat4& Scene::localTransform(const mgl::SceneNode* node) const {
+    int index = indexOf(node);
+    return index < 0 ? node->transform : local_[index];
+}
+
+const glm::mat4& Scene::worldTransform(const mgl::SceneNode* node) const {
+    static const glm::mat4 identity(1.0f);
+    int index = indexOf(node);
+    return index < 0 ? identity : world_[index];
+}
+
+void Scene::markDirty(size_t index) {
+    if (dirty_[index]) return;
+    dirty_[index] = 1;
+    dirtyRoots_.push_back((int)index);
+}
+
+void Scene::invalidateBounds() {
+    if (nodes_.empty()) return;
+    std::fill(dirty_.begin(), dirty_.end(), (uint8_t)1);
+    dirtyRoots_.clear();
+    allDirty_ = true;
+}
+
+void Scene::replaceShader(mgl::ShaderProgram* from, mgl::ShaderProgram* to) {
+    materialIds_.clear();
+    for (uint32_t id = 0; id < materials_.size(); id++) {
+        Material& m = materials_[id];
+        if (m.shader == from) m.shader = to;
+        // Two materials may now collide; the first id keeps the key.
+        materialIds_.emplace(std::make_tuple(m.shader, m.color.r, m.color.g, m.color.b, m.color.a), id);
+    }
+}
+
+// Stable depth-first reorder of every array, so each subtree is contiguous.
+void Scene::relayout() {
+    size_t n = nodes_.size();
+    std::vector<int> childStart(n + 1, 0), children(n);
+    for (size_t i = 0; i < n; i++) {
+        if (parent_[i] >= 0) childStart[parent_[i] + 1]++;
+    }
+    for (size_t i = 0; i < n; i++) childStart[i + 1] += childStart[i];
+    std::vector<int> fill(childStart.begin(), childStart.end() - 1);
+    for (size_t i = 0; i < n; i++) {
+        if (parent_[i] >= 0) children[fill[parent_[i]]++] = (int)i;
+    }
+
+    std::vector<int> order;
+    order.reserve(n);
+    std::vector<int> stack;
+    for (size_t r = n; r-- > 0;) {
+        if (parent_[r] < 0) stack.push_back((int)r);
+    }
+    while (!stack.empty()) {
+        int i = stack.back();
+        stack.pop_back();
+        order.push_back(i);
+        for (int c = childStart[i + 1]; c-- > childStart[i];) stack.push_back(children[c]);
+    }
+
+    std::vector<int> newIndex(n);
+    for (size_t k = 0; k < n; k++) newIndex[order[k]] = (int)k;
+
+    auto permute = [&](auto& v) {
+        auto old = v;
+        for (size_t k = 0; k < n; k++) v[k] = old[order[k]];
+    };
+    permute(nodes_);
+    permute(parent_);
+    permute(mesh_);
+    permute(material_);
+    permute(local_);
+    permute(world_);
+    permute(normal_);
+    permute(dirty_);
+    permute(lod_);
+    permute(occluded_);
+    permute(edited_);
+    permute(proxy_);
+    for (int& p : parent_) {
+        if (p >= 0) p = newIndex[p];
+    }
+    for (size_t k = 0; k < n; k++) {
+        if (proxy_[k] >= 0) spatial_.setData(proxy_[k], (int)k);
+    }
+
+    // Sizes and mesh counts accumulate child to parent, back to front.
+    for (size_t k = 0; k < n; k++) {
+        subtreeSize_[k] = 1;
+        meshCount_[k] = mesh_[k] ? 1 : 0;
+        index_[nodes_[k]] = (int)k;
+    }
+    for (size_t k = n; k-- > 1;) {
+        if (parent_[k] >= 0) {
+            subtreeSize_[parent_[k]] += subtreeSize_[k];
+            meshCount_[parent_[k]] += meshCount_[k];
+        }
+    }
+
+    std::fill(dirty_.begin(), dirty_.end(), (uint8_t)1);
+    dirtyRoots_.clear();
+    allDirty_ = n > 0;
+    layoutDirty_ = false;
+    partition();
+}
+
+// Nodes with at most PARALLEL_GRAIN nodes in their subtree start a range,
+// and neighbouring ranges are joined while they stay that small; larger
+// subtrees leave their root on the spine and are split below it.
+void Scene::partition() {
+    ranges_.clear();
+    spine_.clear();
+    tops_.clear();
+    size_t n = nodes_.size();
+    size_t i = 0;
+    while (i < n) {
+        size_t end = i + subtreeSize_[i];
+        tops_.push_back((int)i);
+        if (end - i > PARALLEL_GRAIN) {
+            spine_.push_back((int)i);
+            i++;
+            continue;
+        }
+        if (!ranges_.empty() && ranges_.back().end == i && end - ranges_.back().begin <= PARALLEL_GRAIN) {
+            ranges_.back().end = end;
+        }
+        else {
+            ranges_.push_back({ i, end, false });
+        }
+        i = end;
+    }
+}
+
+void Scene::update() {
+    if (layoutDirty_) relayout();
+    if (!allDirty_ && dirtyRoots_.empty()) return;
+
+    size_t n = nodes_.size();
+    if (allDirty_ || collectDirtyRoots() > FULL_UPDATE_SHARE * n) updateAll();
+    else updateSubtrees();
+    dirtyRoots_.clear();
+    allDirty_ = false;
+}
+
+// Sorts the marked nodes and drops those inside another one's subtree.
+// Returns the number of nodes in the subtrees that are left.
+size_t Scene::collectDirtyRoots() {
+    std::sort(dirtyRoots_.begin(), dirtyRoots_.end());
+    size_t kept = 0, nodes = 0, end = 0;
+    for (int r : dirtyRoots_) {
+        if ((size_t)r < end) continue;
+        dirtyRoots_[kept++] = r;
+        end = r + subtreeSize_[r];
+        nodes += subtreeSize_[r];
+    }
+    dirtyRoots_.resize(kept);
+    return nodes;
+}
+
+void Scene::updateAll() {
+    size_t n = nodes_.size();
+    if (!jobs_ || ranges_.size() <= 1) {
+        recomputed_ += updateRange(0, n);
+        updateBounds(0, n);
+    }
+    else {
+        // The spine first, so every range finds its ancestors up to date.
+        for (int s : spine_) recomputed_ += updateRange(s, s + 1);
+        std::atomic<int> recomputed(0);
+        jobs_->parallelFor(ranges_.size(), 1, [&](size_t first, size_t last, unsigned) {
+            int count = 0;
+            for (size_t r = first; r < last; r++) {
+                const Range& range = ranges_[r];
+                count += updateRange(range.begin, range.end);
+                updateBounds(range.begin, range.end);
+            }
+            recomputed += count;
+        });
+        recomputed_ += recomputed;
+
+        // Ranges are refit; what is left is merging their roots and the
+        // spine, back to front.
+        for (int s : spine_) bounds_[s] = meshBounds_[s];
+        for (size_t k = tops_.size(); k-- > 0;) {
+            int p = parent_[tops_[k]];
+            if (p >= 0) bounds_[p].expand(bounds_[tops_[k]]);
+        }
+    }
+    updateSpatialIndex(0, n);
+    std::memset(dirty_.data(), 0, n);
+}
+
+// Each dirty subtree's ancestors are clean (a dirty one would have been
+// the root instead), so it can be updated on its own.
+void Scene::updateSubtrees() {
+    for (int r : dirtyRoots_) {
+        size_t end = r + subtreeSize_[r];
+        recomputed_ += updateRange(r, end);
+        updateBounds(r, end);
+        updateSpatialIndex(r, end);
+        std::memset(dirty_.data() + r, 0, end - r);
+    }
+    updateAncestors();
+}
+
+// Parents precede children, so one forward pass sees a parent's new world
+// matrix (and its dirty flag) before any of its children. Each run of dirty
+// nodes goes to TransformBatch::propagate() as a whole; its parents are in
+// the run or in earlier ones. Parents before `begin` must be up to date.
+// Returns the number of matrices recomputed.
+int Scene::updateRange(size_t begin, size_t end) {
+    int recomputed = 0;
+    size_t i = begin;
+    while (i < end) {
+        size_t run = i;
+        for (; i < end; i++) {
+            int p = parent_[i];
+            if (p >= 0 && dirty_[p]) dirty_[i] = 1;
+            if (!dirty_[i]) break;
+        }
+        if (i > run) {
+            TransformBatch::propagate(parent_.data(), local_.data(), world_.data(), run, i);
+            for (size_t k = run; k < i; k++) updateDerived(k);
+            recomputed += (int)(i - run);
+        }
+        if (i < end) i++;
+    }
+    return recomputed;
+}
+
+// Normal matrix and world bounds of a node whose world matrix changed.
+void Scene::updateDerived(size_t index) {
+    normal_[index] = glm::transpose(glm::inverse(glm::mat3(world_[index])));
+    const MeshBuffers* mesh = mesh_[index];
+    if (mesh && mesh->ready()) {
+        meshBounds_[index] = mesh->bounds().transformed(world_[index]);
+        sphere_[index] = mesh->sphere().transformed(world_[index]);
+    }
+    else {
+        meshBounds_[index] = AABB();
+        sphere_[index] = Sphere();
+    }
+}
+
+// Children follow their parent, so a backward pass has every child merged
+// before its parent is merged into the grandparent. Parents before `begin`
+// are left to the caller.
+void Scene::updateBounds(size_t begin, size_t end) {
+    std::copy(meshBounds_.begin() + begin, meshBounds_.begin() + end, bounds_.begin() + begin);
+    for (size_t i = end; i-- > begin;) {
+        int p = parent_[i];
+        if (p >= (int)begin) bounds_[p].expand(bounds_[i]);
+    }
+}
+
+// Recomputes the bounds of every ancestor of a dirty subtree from its own
+// mesh and its children, deepest first. Costs the ancestors' children, not
+// the whole scene.
+void Scene::updateAncestors() {
+    ancestors_.clear();
+    for (int r : dirtyRoots_) {
+        for (int p = parent_[r]; p >= 0; p = parent_[p]) ancestors_.push_back(p);
+    }
+    std::sort(ancestors_.begin(), ancestors_.end());
+    ancestors_.erase(std::unique(ancestors_.begin(), ancestors_.end()), ancestors_.end());
+    // Children come after their parent, so back to front sees them first.
+    for (size_t k = ancestors_.size(); k-- > 0;) {
+        int a = ancestors_[k];
+        AABB& box = bounds_[a];
+        box = meshBounds_[a];
+        int end = a + subtreeSize_[a];
+        for (int c = a + 1; c < end; c += subtreeSize_[c]) box.expand(bounds_[c]);
+    }
+}
+
+// Nodes still flagged dirty are the ones whose bounds were recomputed.
+void Scene::updateSpatialIndex(size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (!dirty_[i]) continue;
+        const AABB& box = meshBounds_[i];
+        int& proxy = proxy_[i];
+        if (box.isEmpty()) {
+            if (proxy >= 0) spatial_.remove(proxy);
+            proxy = -1;
+        }
+        else if (proxy < 0) {
+            proxy = spatial_.insert(box, (int)i);
+        }
+        else {
+            spatial_.move(proxy, box);
+        }
+    }
+}
+
+Scene::LodView Scene::lodView(const glm::mat4& view, const glm::mat4& projection, int viewportHeight,
+    bool orthographic, float tolerance) {
+    LodView v;
+    v.eye = glm::vec3(glm::inverse(view)[3]);
+    v.pixelsPerUnit = projection[1][1] * 0.5f * (float)viewportHeight;
+    v.orthographic = orthographic;
+    v.tolerance = tolerance;
+    return v;
+}
+
+unsigned Scene::selectLod(size_t index, const MeshBuffers* mesh, const LodView& view, int& switches) {
+    unsigned levels = mesh->lodCount();
+    if (levels <= 1) return 0;
+
+    // Pixels covered by one mesh unit at this node's nearest point.
+    const Sphere& sphere = sphere_[index];
+    float pixels = view.pixelsPerUnit;
+    if (mesh->sphere().radius > 0.0f) pixels *= sphere.radius / mesh->sphere().radius;
+    if (!view.orthographic) pixels /= std::max(glm::distance(view.eye, sphere.center) - sphere.radius, 1e-3f);
+
+    auto coarsest = [&](float tolerance) {
+        unsigned level = 0;
+        while (level + 1 < levels && mesh->lod(level + 1).error * pixels <= tolerance) level++;
+        return level;
+    };
+    unsigned current = std::min((unsigned)lod_[index], levels - 1);
+    unsigned level = coarsest(view.tolerance * LOD_HYSTERESIS);
+    if (level <= current) {
+        // Finer only once the current level is visibly too coarse.
+        level = mesh->lod(current).error * pixels > view.tolerance ? coarsest(view.tolerance) : current;
+    }
+    if (level != lod_[index]) {
+        lod_[index] = (uint8_t)level;
+        switches++;
+    }
+    return level;
+}
+
+void Scene::clearOccluded() {
+    std::fill(occluded_.begin(), occluded_.end(), (uint8_t)0);
+}
+
+void Scene::DrawList::reset(const Range& r, bool isJob) {
+    range = r;
+    job = isJob;
+    packets.clear();
+    inFrustum.clear();
+    culled = 0;
+    lodSwitches = 0;
+    occludedDraws = 0;
+    occludedTriangles = 0;
+}
+
+// One step of the culled walk: handles node i and returns the next node to
+// visit. Nodes below insideEnd belong to a subtree found fully inside the
+// frustum and need no further tests.
+size_t Scene::drawStep(DrawList& list, size_t i, size_t& insideEnd, const Frustum* frustum, const LodView* lod) {
+    if (bounds_[i].isEmpty()) return i + subtreeSize_[i];
+
+    bool inside = i < insideEnd;
+    if (!inside) {
+        Frustum::Result result = frustum->test(bounds_[i]);
+        if (result == Frustum::OUTSIDE) {
+            list.culled += meshCount_[i];
+            return i + subtreeSize_[i];
+        }
+        if (result == Frustum::INSIDE) {
+            insideEnd = i + subtreeSize_[i];
+            inside = true;
+        }
+    }
+
+    const MeshBuffers* mesh = mesh_[i];
+    if (mesh && mesh->ready()) {
+        // Sphere first: cheaper, and rejects most of what the box would.
+        if (inside || (frustum->intersects(sphere_[i]) && frustum->test(meshBounds_[i]) != Frustum::OUTSIDE)) {
+            list.inFrustum.push_back((int)i);
+            unsigned level = lod ? selectLod(i, mesh, *lod, list.lodSwitches) : 0;
+            if (occluded_[i]) {
+                list.occludedDraws++;
+                list.occludedTriangles += mesh->indexCount(level) / 3;
+            }
+            else {
+                list.packets.push_back({ (uint32_t)i, level });
+            }
+        }
+        else {
+            list.culled++;
+        }
+    }
+    return i + 1;
+}
+
+void Scene::drawRange(DrawList& list, const Frustum* frustum, const LodView* lod) {
+    size_t insideEnd = list.range.inside ? list.range.end : list.range.begin;
+    for (size_t i = list.range.begin; i < list.range.end;) i = drawStep(list, i, insideEnd, frustum, lod);
+}
+
+void Scene::draw(IDrawSink& sink, const Frustum* frustum, const LodView* lod) {
+    size_t n = nodes_.size();
+    size_t used = 0;
+    auto next = [&](const Range& range, bool job) -> DrawList& {
+        if (used == lists_.size()) lists_.emplace_back();
+        lists_[used].reset(range, job);
+        return lists_[used++];
+    };
+
+    if (!jobs_ || ranges_.size() <= 1) {
+        drawRange(next({ 0, n, !frustum }, false), frustum, lod);
+    }
+    else {
+        // Spine nodes are culled here, in runs that share a list; the whole
+        // subtrees below them become jobs.
+        size_t insideEnd = frustum ? 0 : n;
+        size_t i = 0;
+        while (i < n) {
+            size_t end = i + subtreeSize_[i];
+            if (end - i > PARALLEL_GRAIN) {
+                DrawList& list = used > 0 && !lists_[used - 1].job ? lists_[used - 1] : next({ i, i, false }, false);
+                i = drawStep(list, i, insideEnd, frustum, lod);
+                continue;
+            }
+            bool inside = i < insideEnd;
+            DrawList* last = used > 0 ? &lists_[used - 1] : nullptr;
+            if (last && last->job && last->range.end == i && last->range.inside == inside
+                && end - last->range.begin <= PARALLEL_GRAIN) {
+                last->range.end = end;
+            }
+            else {
+                next({ i, end, inside }, true);
+            }
+            i = end;
+        }
+        jobs_->parallelFor(used, 1, [&](size_t first, size_t last, unsigned) {
+            for (size_t k = first; k < last; k++) {
+                if (lists_[k].job) drawRange(lists_[k], frustum, lod);
+            }
+        });
+    }
+
+    // Merged in node order, so the sink sees the same sequence either way.
+    drawn_ = 0;
+    culled_ = 0;
+    lodSwitches_ = 0;
+    occludedDraws_ = 0;
+    occludedTriangles_ = 0;
+    inFrustum_.clear();
+    for (size_t k = 0; k < used; k++) {
+        const DrawList& list = lists_[k];
+        for (const DrawPacket& packet : list.packets) {
+            const Material& m = materials_[material_[packet.index]];
+            sink.add(mesh_[packet.index], packet.level, m.shader, world_[packet.index], normal_[packet.index],
+                m.color);
+        }
+        drawn_ += (int)list.packets.size();
+        culled_ += list.culled;
+        lodSwitches_ += list.lodSwitches;
+        occludedDraws_ += list.occludedDraws;
+        occludedTriangles_ += list.occludedTriangles;
+        inFrustum_.insert(inFrustum_.end(), list.inFrustum.begin(), list.inFrustum.end());
+    }
+}
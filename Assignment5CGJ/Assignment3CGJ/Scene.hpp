@@ -0,0 +1,224 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include "../mgl/mgl.hpp"
+#include "../mgl/mglSceneNode.hpp"
+#include "DrawSink.hpp"
+#include "Frustum.hpp"
+#include "JobSystem.hpp"
+#include "MeshBuffers.hpp"
+#include "SpatialIndex.hpp"
+
+// Flat, structure-of-arrays scene storage. mgl::SceneNode pointers are kept
+// only as handles; parent indices, local, world and normal matrices, bounds
+// and material ids live in parallel arrays in depth-first order, so every
+// subtree is the contiguous range [i, i + subtreeSize[i]).
+//
+// Local edits mark a node dirty; update() recomputes the world matrices of
+// each dirty node's subtree in one forward pass, refits that subtree's
+// bounds in one backward pass, then refits its ancestors. Only when most of
+// the scene is dirty does it redo every node. draw() walks the arrays
+// linearly, skips whole ranges that are outside the view frustum and picks
+// each mesh's level of detail from its projected size. Nodes an
+// OcclusionCuller marked occluded are skipped as well.
+//
+// With a JobSystem both passes run in parallel: the arrays are cut into
+// ranges of whole subtrees, and only the few nodes above them (the spine)
+// are handled on the calling thread. draw() collects each range's draws in
+// a list of its own and hands the lists to the sink in node order, so the
+// sink, and with it every GL call, stays on the calling thread.
+//
+// update() also keeps a SpatialIndex over the world bounds of the drawable
+// nodes, for questions about a region rather than a subtree: what a ray
+// hits, what lies near a light, what is inside a box.
+class Scene {
+public:
+    // Parents must be added before their children. A parent that was never
+    // added (e.g. the empty root) is treated as the identity.
+    // Nodes without a mesh only contribute their transform.
+    int add(mgl::SceneNode* node, mgl::SceneNode* parent, const MeshBuffers* mesh, const glm::vec4& color,
+        mgl::ShaderProgram* shader);
+    void clear();
+    void reserve(size_t count);
+
+    // All local transform edits must go through here to keep the cache valid.
+    void setLocalTransform(mgl::SceneNode* node, const glm::mat4& local);
+    const glm::mat4& localTransform(const mgl::SceneNode* node) const;
+    const glm::mat4& worldTransform(const mgl::SceneNode* node) const;
+
+    void update();
+
+    // Edits or additions that the next update() has not applied yet.
+    bool dirty() const { return layoutDirty_ || allDirty_ || !dirtyRoots_.empty(); }
+
+    // Moves the nodes whose local transform was set since the last call
+    // into `edits`, once each; each moved with its subtree. Edits are kept
+    // however many update()s run in between, so call it after an update()
+    // to see them applied.
+    void takeEdits(std::vector<const mgl::SceneNode*>& edits);
+
+    // Subtrees of at most this many nodes go to one job.
+    static const size_t PARALLEL_GRAIN = 512;
+
+    // Spreads update() and draw() over `jobs`; nullptr (the default) keeps
+    // them on the calling thread.
+    void setJobSystem(JobSystem* jobs) { jobs_ = jobs; }
+
+    // Points every node drawn with `from` at `to` (e.g. another permutation
+    // of the same shader).
+    void replaceShader(mgl::ShaderProgram* from, mgl::ShaderProgram* to);
+
+    // Recomputes every bound on the next update(); call when meshes finish
+    // loading, since their bounds are only known after upload.
+    void invalidateBounds();
+
+    // Level-of-detail selection: every node shows the coarsest level whose
+    // simplification error covers at most `tolerance` pixels on screen.
+    struct LodView {
+        glm::vec3 eye;
+        float pixelsPerUnit;    // one unit on screen, at distance 1 unless orthographic
+        bool orthographic;
+        float tolerance;
+    };
+    static LodView lodView(const glm::mat4& view, const glm::mat4& projection, int viewportHeight,
+        bool orthographic, float tolerance = 1.0f);
+
+    // Hands every visible drawable node to the sink (a RenderQueue or an
+    // InstanceBatcher, which the caller flushes). With a frustum, subtrees
+    // whose bounds are outside it are skipped; without a LodView every mesh
+    // is drawn at level 0.
+    void draw(IDrawSink& sink, const Frustum* frustum = nullptr, const LodView* lod = nullptr);
+
+    // Index into the arrays; only stable until the next add() or clear().
+    int indexOf(const mgl::SceneNode* node) const;
+    size_t size() const { return nodes_.size(); }
+    mgl::SceneNode* node(int index) const { return nodes_[index]; }
+    int subtreeSize(int index) const { return subtreeSize_[index]; }
+    const MeshBuffers* mesh(int index) const { return mesh_[index]; }
+    const glm::mat4& world(int index) const { return world_[index]; }
+    const AABB& meshBounds(int index) const { return meshBounds_[index]; }
+
+    // Query results are node indices, and as valid as indexOf()'s. Only
+    // meshes that are ready are in it.
+    const SpatialIndex& spatialIndex() const { return spatial_; }
+
+    // Occlusion results (from an earlier frame) that the next draw() obeys.
+    void setOccluded(int index, bool occluded) { occluded_[index] = occluded; }
+    bool occluded(int index) const { return occluded_[index] != 0; }
+    void clearOccluded();
+
+    // Drawable nodes the last draw() found inside the frustum, whether or
+    // not they were occluded: the ones worth testing for occlusion.
+    const std::vector<int>& inFrustum() const { return inFrustum_; }
+
+    // World matrices recomputed since the last resetStats(); the app resets
+    // it once per frame.
+    int recomputedCount() const { return recomputed_; }
+    void resetStats() { recomputed_ = 0; }
+
+    // Nodes drawn and culled by the last draw().
+    int drawnCount() const { return drawn_; }
+    int culledCount() const { return culled_; }
+
+    // Nodes whose level of detail changed in the last draw().
+    int lodSwitchCount() const { return lodSwitches_; }
+
+    // Draws and triangles the last draw() skipped as occluded.
+    int occludedCount() const { return occludedDraws_; }
+    int occludedTriangles() const { return occludedTriangles_; }
+
+private:
+    struct Material {
+        glm::vec4 color;
+        mgl::ShaderProgram* shader;
+    };
+
+    // Whole subtrees [begin, end); `inside` if an ancestor was found fully
+    // inside the frustum.
+    struct Range {
+        size_t begin;
+        size_t end;
+        bool inside;
+    };
+
+    struct DrawPacket {
+        uint32_t index;
+        uint32_t level;
+    };
+
+    // What draw() found in one range (or in a run of spine nodes).
+    struct DrawList {
+        Range range;
+        bool job;
+        std::vector<DrawPacket> packets;
+        std::vector<int> inFrustum;
+        int culled;
+        int lodSwitches;
+        int occludedDraws;
+        int occludedTriangles;
+
+        void reset(const Range& r, bool isJob);
+    };
+
+    // Parallel arrays, one element per node.
+    std::vector<mgl::SceneNode*> nodes_;
+    std::vector<int> parent_;
+    std::vector<int> subtreeSize_;
+    std::vector<int> meshCount_;      // drawable nodes in the subtree
+    std::vector<const MeshBuffers*> mesh_;
+    std::vector<uint32_t> material_;
+    std::vector<glm::mat4> local_;
+    std::vector<glm::mat4> world_;
+    std::vector<glm::mat3> normal_;   // inverse transpose of world, for shading
+    std::vector<AABB> meshBounds_;    // world space, own mesh only
+    std::vector<Sphere> sphere_;      // world space, own mesh only
+    std::vector<AABB> bounds_;        // world space, whole subtree
+    std::vector<uint8_t> dirty_;
+    std::vector<uint8_t> lod_;        // level drawn last, for hysteresis
+    std::vector<uint8_t> occluded_;
+    std::vector<uint8_t> edited_;     // in edits_
+    std::vector<int> proxy_;          // in spatial_, or -1
+
+    std::vector<Material> materials_;
+    std::map<std::tuple<mgl::ShaderProgram*, float, float, float, float>, uint32_t> materialIds_;
+    std::unordered_map<const mgl::SceneNode*, int> index_;
+    std::vector<const mgl::SceneNode*> edits_;
+    SpatialIndex spatial_;
+
+    std::vector<int> dirtyRoots_;     // marked since the last update()
+    std::vector<int> ancestors_;      // of dirtyRoots_, during update()
+    bool allDirty_ = false;
+    bool layoutDirty_ = false;
+    int recomputed_ = 0;
+    int drawn_ = 0;
+    int culled_ = 0;
+    int lodSwitches_ = 0;
+    int occludedDraws_ = 0;
+    int occludedTriangles_ = 0;
+    std::vector<int> inFrustum_;
+
+    JobSystem* jobs_ = nullptr;
+    std::vector<Range> ranges_;       // update() jobs, rebuilt by relayout()
+    std::vector<int> spine_;          // nodes above the ranges
+    std::vector<int> tops_;           // spine and range subtree roots
+    std::vector<DrawList> lists_;     // reused from frame to frame
+
+    uint32_t materialOf(const glm::vec4& color, mgl::ShaderProgram* shader);
+    void markDirty(size_t index);
+    void relayout();
+    void partition();
+    size_t collectDirtyRoots();
+    void updateAll();
+    void updateSubtrees();
+    int updateRange(size_t begin, size_t end);
+    void updateDerived(size_t index);
+    void updateBounds(size_t begin, size_t end);
+    void updateAncestors();
+    void updateSpatialIndex(size_t begin, size_t end);
+    unsigned selectLod(size_t index, const MeshBuffers* mesh, const LodView& view, int& switches);
+    size_t drawStep(DrawList& list, size_t i, size_t& insideEnd, const Frustum* frustum, const LodView* lod);
+    void drawRange(DrawList& list, const Frustum* frustum, const LodView* lod);
+};
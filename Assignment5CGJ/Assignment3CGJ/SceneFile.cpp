@@ -0,0 +1,258 @@
+#include "SceneFile.hpp"
+#include "MappedFile.hpp"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace {
+
+const char MAGIC[4] = { 'S', 'B', 'I', 'N' };
+const uint32_t VERSION = 1;
+
+struct BinaryHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t meshCount;
+    uint32_t nodeCount;
+    uint32_t stringBytes;
+    uint32_t reserved;
+};
+
+struct BinaryMesh {
+    uint32_t pathOffset;
+    uint32_t pathLength;
+};
+
+struct BinaryNode {
+    int32_t parent;
+    int32_t mesh;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+    float color[4];
+    float transform[16];
+};
+
+}
+
+int SceneDesc::findNode(const std::string& name) const {
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].name == name) return (int)i;
+    }
+    return -1;
+}
+
+bool SceneDesc::isText(const std::string& path) {
+    const std::string ext = ".scene";
+    return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+bool SceneDesc::load(const std::string& path) {
+    return isText(path) ? loadText(path) : loadBinary(path);
+}
+
+bool SceneDesc::save(const std::string& path) const {
+    return isText(path) ? saveText(path) : saveBinary(path);
+}
+
+bool SceneDesc::loadText(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        std::cerr << "Cannot open scene " << path << std::endl;
+        return false;
+    }
+    // Parsed aside, so a bad file leaves this description as it was.
+    SceneDesc desc;
+    std::unordered_map<std::string, int> meshByName, meshByPath, nodeByName;
+    std::string line;
+    int lineNumber = 0;
+    auto fail = [&](const std::string& what) {
+        std::cerr << path << ":" << lineNumber << ": " << what << std::endl;
+        return false;
+    };
+
+    while (std::getline(in, line)) {
+        lineNumber++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream ls(line);
+        std::string keyword;
+        if (!(ls >> keyword)) continue;
+
+        if (keyword == "mesh") {
+            std::string name, file;
+            if (!(ls >> name >> file)) return fail("expected: mesh <name> <path>");
+            // Several names may point at one file; they share the mesh.
+            auto it = meshByPath.find(file);
+            if (it == meshByPath.end()) {
+                it = meshByPath.emplace(file, (int)desc.meshes.size()).first;
+                desc.meshes.push_back(file);
+            }
+            meshByName[name] = it->second;
+        }
+        else if (keyword == "node") {
+            Node node;
+            std::string parent, mesh;
+            if (!(ls >> node.name >> parent >> mesh >> node.color.r >> node.color.g >> node.color.b >> node.color.a)) {
+                return fail("expected: node <name> <parent> <mesh> <r> <g> <b> <a>");
+            }
+            if (parent != "-") {
+                auto it = nodeByName.find(parent);
+                if (it == nodeByName.end()) return fail("unknown parent " + parent);
+                node.parent = it->second;
+            }
+            if (mesh != "-") {
+                auto it = meshByName.find(mesh);
+                if (it == meshByName.end()) return fail("unknown mesh " + mesh);
+                node.mesh = it->second;
+            }
+
+            std::string op;
+            while (ls >> op) {
+                glm::vec3 v;
+                if (op == "translate" && ls >> v.x >> v.y >> v.z) {
+                    node.transform = glm::translate(node.transform, v);
+                }
+                else if (op == "scale" && ls >> v.x >> v.y >> v.z) {
+                    node.transform = glm::scale(node.transform, v);
+                }
+                else if (op == "rotate") {
+                    float degrees;
+                    if (!(ls >> degrees >> v.x >> v.y >> v.z)) return fail("expected: rotate <degrees> <x> <y> <z>");
+                    node.transform = glm::rotate(node.transform, glm::radians(degrees), v);
+                }
+                else if (op == "matrix") {
+                    float* m = glm::value_ptr(node.transform);
+                    for (int i = 0; i < 16; i++) {
+                        if (!(ls >> m[i])) return fail("expected 16 matrix values");
+                    }
+                }
+                else {
+                    return fail("bad transform " + op);
+                }
+            }
+
+            if (!nodeByName.emplace(node.name, (int)desc.nodes.size()).second) {
+                return fail("duplicate node " + node.name);
+            }
+            desc.nodes.push_back(node);
+        }
+        else {
+            return fail("unknown statement " + keyword);
+        }
+    }
+    *this = std::move(desc);
+    return true;
+}
+
+// Mesh names are written as m<index>; transforms as full matrices so that
+// edits round-trip exactly.
+bool SceneDesc::saveText(const std::string& path) const {
+    std::ofstream out(path);
+    if (!out) return false;
+    out.precision(9);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        out << "mesh m" << i << " " << meshes[i] << "\n";
+    }
+    for (const Node& n : nodes) {
+        out << "node " << n.name << " " << (n.parent < 0 ? "-" : nodes[n.parent].name) << " ";
+        if (n.mesh < 0) out << "-";
+        else out << "m" << n.mesh;
+        out << " " << n.color.r << " " << n.color.g << " " << n.color.b << " " << n.color.a;
+        if (n.transform != glm::mat4(1.0f)) {
+            out << " matrix";
+            const float* m = glm::value_ptr(n.transform);
+            for (int i = 0; i < 16; i++) out << " " << m[i];
+        }
+        out << "\n";
+    }
+    return (bool)out;
+}
+
+bool SceneDesc::loadBinary(const std::string& path) {
+    MappedFile file;
+    if (!file.open(path)) {
+        std::cerr << "Cannot open scene " << path << std::endl;
+        return false;
+    }
+
+    const unsigned char* data = file.data();
+    const BinaryHeader* h = reinterpret_cast<const BinaryHeader*>(data);
+    if (file.size() < sizeof(BinaryHeader) || std::memcmp(h->magic, MAGIC, 4) != 0 || h->version != VERSION
+        || file.size() != sizeof(BinaryHeader) + h->meshCount * sizeof(BinaryMesh)
+            + (size_t)h->nodeCount * sizeof(BinaryNode) + h->stringBytes) {
+        std::cerr << path << ": not a valid binary scene" << std::endl;
+        return false;
+    }
+
+    const BinaryMesh* meshRecords = reinterpret_cast<const BinaryMesh*>(data + sizeof(BinaryHeader));
+    const BinaryNode* nodeRecords = reinterpret_cast<const BinaryNode*>(meshRecords + h->meshCount);
+    const char* strings = reinterpret_cast<const char*>(nodeRecords + h->nodeCount);
+    auto text = [&](uint32_t offset, uint32_t length) {
+        if ((uint64_t)offset + length > h->stringBytes) return std::string();
+        return std::string(strings + offset, length);
+    };
+
+    SceneDesc desc;
+    desc.meshes.resize(h->meshCount);
+    for (uint32_t i = 0; i < h->meshCount; i++) {
+        desc.meshes[i] = text(meshRecords[i].pathOffset, meshRecords[i].pathLength);
+    }
+
+    desc.nodes.resize(h->nodeCount);
+    for (uint32_t i = 0; i < h->nodeCount; i++) {
+        const BinaryNode& r = nodeRecords[i];
+        if (r.parent >= (int32_t)i || r.mesh >= (int32_t)h->meshCount) {
+            std::cerr << path << ": bad node " << i << std::endl;
+            return false;
+        }
+        Node& n = desc.nodes[i];
+        n.name = text(r.nameOffset, r.nameLength);
+        n.parent = r.parent;
+        n.mesh = r.mesh;
+        n.color = glm::make_vec4(r.color);
+        n.transform = glm::make_mat4(r.transform);
+    }
+    *this = std::move(desc);
+    return true;
+}
+
+bool SceneDesc::saveBinary(const std::string& path) const {
+    std::string strings;
+    std::vector<BinaryMesh> meshRecords(meshes.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        meshRecords[i] = { (uint32_t)strings.size(), (uint32_t)meshes[i].size() };
+        strings += meshes[i];
+    }
+    std::vector<BinaryNode> nodeRecords(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++) {
+        BinaryNode& r = nodeRecords[i];
+        r.parent = nodes[i].parent;
+        r.mesh = nodes[i].mesh;
+        r.nameOffset = (uint32_t)strings.size();
+        r.nameLength = (uint32_t)nodes[i].name.size();
+        std::memcpy(r.color, glm::value_ptr(nodes[i].color), sizeof(r.color));
+        std::memcpy(r.transform, glm::value_ptr(nodes[i].transform), sizeof(r.transform));
+        strings += nodes[i].name;
+    }
+
+    BinaryHeader h;
+    std::memcpy(h.magic, MAGIC, 4);
+    h.version = VERSION;
+    h.meshCount = (uint32_t)meshRecords.size();
+    h.nodeCount = (uint32_t)nodeRecords.size();
+    h.stringBytes = (uint32_t)strings.size();
+    h.reserved = 0;
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return false;
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(reinterpret_cast<const char*>(meshRecords.data()), meshRecords.size() * sizeof(BinaryMesh));
+    out.write(reinterpret_cast<const char*>(nodeRecords.data()), nodeRecords.size() * sizeof(BinaryNode));
+    out.write(strings.data(), strings.size());
+    return (bool)out;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// Scene description: mesh references, node hierarchy, local transforms
+// and colours. Nodes are stored parents-first, so one forward pass can
+// build the scene.
+//
+// Text form (.scene), one statement per line, '#' starts a comment:
+//
+//   mesh <name> <path>
+//   node <name> <parent|-> <mesh|-> <r> <g> <b> <a> [transform ops...]
+//
+// Transform ops are applied left to right like glm::translate/rotate/scale:
+//   translate x y z | rotate degrees ax ay az | scale x y z | matrix m0..m15
+// (matrix is column-major and replaces what came before).
+//
+// Binary form (.sbin) is written by save() for any other extension and is
+// read with a single memory map: a header, the node records, then one
+// blob with every string.
+struct SceneDesc {
+    struct Node {
+        std::string name;
+        int parent = -1;
+        int mesh = -1;
+        glm::vec4 color = glm::vec4(1.0f);
+        glm::mat4 transform = glm::mat4(1.0f);
+    };
+
+    // Mesh paths, de-duplicated; nodes refer to them by index.
+    std::vector<std::string> meshes;
+    std::vector<Node> nodes;
+
+    int findNode(const std::string& name) const;
+
+    // On failure the description is left as it was.
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    bool loadText(const std::string& path);
+    bool saveText(const std::string& path) const;
+    bool loadBinary(const std::string& path);
+    bool saveBinary(const std::string& path) const;
+
+    static bool isText(const std::string& path);
+};
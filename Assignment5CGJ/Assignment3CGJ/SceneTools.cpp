@@ -0,0 +1,114 @@
+#include "SceneTools.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "SceneFile.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+
+// Text scene -> binary .sbin next to it, timing both loads.
+static bool convertScene(const std::string& path) {
+    using clock = std::chrono::steady_clock;
+    SceneDesc desc;
+    auto t0 = clock::now();
+    if (!desc.loadText(path)) return false;
+    auto t1 = clock::now();
+    std::string binary = path.substr(0, path.size() - 6) + ".sbin";
+    if (!desc.saveBinary(binary)) return false;
+    auto t2 = clock::now();
+    if (!desc.loadBinary(binary)) return false;
+    auto t3 = clock::now();
+    std::cout << path << " -> " << binary << " (" << desc.nodes.size() << " nodes)"
+        << " text " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms"
+        << ", binary " << std::chrono::duration<double, std::milli>(t3 - t2).count() << " ms" << std::endl;
+    return true;
+}
+
+static void printStages(const std::vector<MeshOptimizer::Stage>& stages) {
+    for (const MeshOptimizer::Stage& stage : stages) {
+        std::cout << "  " << std::left << std::setw(28) << stage.name << std::right
+            << " ACMR " << std::fixed << std::setprecision(3) << stage.acmr << std::defaultfloat
+            << ", vertices " << stage.vertexBytes << " bytes, indices " << stage.indexBytes << " bytes" << std::endl;
+    }
+}
+
+namespace SceneTools {
+
+int convert(int count, char* files[]) {
+    using clock = std::chrono::steady_clock;
+    MeshOptimizer::Options options;
+    if (count > 0 && std::strcmp(files[0], "--quantize") == 0) {
+        options.quantize = true;
+        count--;
+        files++;
+    }
+    int failed = 0;
+    for (int i = 0; i < count; i++) {
+        if (SceneDesc::isText(files[i])) {
+            if (!convertScene(files[i])) {
+                std::cerr << files[i] << ": conversion failed" << std::endl;
+                failed++;
+            }
+            continue;
+        }
+        MeshCache cache;
+        auto t0 = clock::now();
+        bool ok = cache.rebuild(files[i], options);
+        auto t1 = clock::now();
+        std::vector<MeshOptimizer::Stage> stages = cache.stages();
+        ok = ok && cache.open(files[i]);
+        auto t2 = clock::now();
+        if (!ok) {
+            std::cerr << files[i] << ": conversion failed" << std::endl;
+            failed++;
+            continue;
+        }
+        std::cout << files[i] << " -> " << MeshCache::cachePath(files[i])
+            << " (" << cache.vertexCount() << " vertices, " << cache.lods()[0].indexCount / 3 << " triangles, "
+            << cache.lodCount() << " levels)"
+            << " import " << std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms"
+            << ", cached " << std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms" << std::endl;
+        printStages(stages);
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+int generateScene(int count, const char* path) {
+    SceneDesc desc;
+    desc.meshes = { "./assets/models/pedestal.obj", "./assets/models/wooden_sword.obj", "./assets/models/candle.obj" };
+    int side = (int)std::ceil(std::sqrt((double)count));
+    desc.nodes.reserve(count + side);
+    int row = -1;
+    for (int i = 0; i < count; i++) {
+        int x = i % side, z = i / side;
+        if (x == 0) {
+            SceneDesc::Node group;
+            group.name = "row" + std::to_string(z);
+            group.transform = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 3.0f * z));
+            row = (int)desc.nodes.size();
+            desc.nodes.push_back(group);
+        }
+        SceneDesc::Node node;
+        node.name = "n" + std::to_string(i);
+        node.parent = row;
+        node.mesh = i % 3;
+        node.color = glm::vec4(0.3f + 0.7f * x / side, 0.3f + 0.7f * z / side, 0.5f, 1.0f);
+        node.transform = glm::translate(glm::mat4(1.0f), glm::vec3(3.0f * x, 0.0f, 0.0f));
+        desc.nodes.push_back(node);
+    }
+    if (!desc.save(path)) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << path << ": " << desc.nodes.size() << " nodes" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+}
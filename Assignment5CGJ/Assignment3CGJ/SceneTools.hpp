@@ -0,0 +1,17 @@
+#pragma once
+
+// Offline asset tools, run from the command line instead of the viewer (see
+// main). Each returns the process exit code.
+namespace SceneTools {
+
+// --convert [--quantize] a.obj b.scene ...: rebuilds the .mbin caches
+// offline, reports what every optimization stage did and compares the
+// Assimp import with loading the fresh cache; .scene files are converted
+// to .sbin.
+int convert(int count, char* files[]);
+
+// --generate-scene N out.scene: a grid of N nodes over the default meshes,
+// grouped under one parent per row, for load and rendering tests.
+int generateScene(int count, const char* path);
+
+}
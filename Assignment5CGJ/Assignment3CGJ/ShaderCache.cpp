@@ -0,0 +1,168 @@
+#include "ShaderCache.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+static const char MAGIC[4] = { 'P', 'B', 'I', 'N' };
+static const uint32_t VERSION = 1;
+
+//   Header | binary[binarySize]
+//          | (uint32 nameLength, name, int32 value) per uniform, then per block
+struct Header {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;
+    uint32_t binaryFormat;
+    uint32_t binarySize;
+    uint32_t uniformCount;
+    uint32_t blockCount;
+};
+
+static void hash(uint64_t& h, const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ull;
+    }
+}
+
+// With its terminator, so "ab" + "c" and "a" + "bc" differ.
+static void hash(uint64_t& h, const std::string& s) {
+    hash(h, s.c_str(), s.size() + 1);
+}
+
+static void hash(uint64_t& h, const GLubyte* s) {
+    hash(h, std::string(s ? reinterpret_cast<const char*>(s) : ""));
+}
+
+bool ShaderCache::supported() {
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+uint64_t ShaderCache::key(const std::string& vertexSource, const std::string& fragmentSource,
+    const mgl::ShaderProgram& program) {
+    uint64_t h = 14695981039346656037ull;
+    hash(h, vertexSource);
+    hash(h, fragmentSource);
+    for (const auto& a : program.Attributes) {
+        hash(h, a.first);
+        hash(h, &a.second.index, sizeof(a.second.index));
+    }
+    hash(h, glGetString(GL_VENDOR));
+    hash(h, glGetString(GL_RENDERER));
+    hash(h, glGetString(GL_VERSION));
+    return h;
+}
+
+std::string ShaderCache::path(const std::string& vertexFile, uint64_t key) {
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)key);
+    return vertexFile + "." + hex + ".pbin";
+}
+
+static bool readEntry(const char*& p, const char* end, std::string& name, GLint& value) {
+    uint32_t length;
+    if (end - p < (ptrdiff_t)sizeof(length)) return false;
+    std::memcpy(&length, p, sizeof(length));
+    p += sizeof(length);
+    if ((size_t)(end - p) < (size_t)length + sizeof(value)) return false;
+    name.assign(p, length);
+    p += length;
+    std::memcpy(&value, p, sizeof(value));
+    p += sizeof(value);
+    return true;
+}
+
+static void writeEntry(std::ofstream& out, const std::string& name, GLint value) {
+    uint32_t length = (uint32_t)name.size();
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(name.data(), length);
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+bool ShaderCache::load(const std::string& path, uint64_t key, mgl::ShaderProgram* program) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return false;
+    std::vector<char> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (file.size() < sizeof(Header)) return false;
+
+    Header h;
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (std::memcmp(h.magic, MAGIC, 4) != 0 || h.version != VERSION || h.key != key
+        || file.size() - sizeof(Header) < h.binarySize) {
+        return false;
+    }
+
+    const char* binary = file.data() + sizeof(Header);
+    glProgramBinary(program->ProgramId, h.binaryFormat, binary, (GLsizei)h.binarySize);
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program->ProgramId, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) return false;
+
+    // Names the entry lacks (a uniform declared since) are looked up.
+    const char* p = binary + h.binarySize;
+    const char* end = file.data() + file.size();
+    std::string name;
+    GLint value;
+    for (auto& u : program->Uniforms) u.second.index = -1;
+    for (uint32_t i = 0; i < h.uniformCount; i++) {
+        if (!readEntry(p, end, name, value)) return false;
+        auto it = program->Uniforms.find(name);
+        if (it != program->Uniforms.end()) it->second.index = value;
+    }
+    for (auto& u : program->Uniforms) {
+        if (u.second.index == -1) u.second.index = glGetUniformLocation(program->ProgramId, u.first.c_str());
+    }
+
+    for (auto& b : program->Ubos) b.second.index = GL_INVALID_INDEX;
+    for (uint32_t i = 0; i < h.blockCount; i++) {
+        if (!readEntry(p, end, name, value)) return false;
+        auto it = program->Ubos.find(name);
+        if (it != program->Ubos.end()) it->second.index = (GLuint)value;
+    }
+    for (auto& b : program->Ubos) {
+        if (b.second.index == GL_INVALID_INDEX) {
+            b.second.index = glGetUniformBlockIndex(program->ProgramId, b.first.c_str());
+        }
+        if (b.second.index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(program->ProgramId, b.second.index, b.second.binding_point);
+        }
+    }
+    return true;
+}
+
+bool ShaderCache::store(const std::string& path, uint64_t key, const mgl::ShaderProgram& program) {
+    GLint size = 0;
+    glGetProgramiv(program.ProgramId, GL_PROGRAM_BINARY_LENGTH, &size);
+    if (size <= 0) return false;
+    std::vector<char> binary(size);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program.ProgramId, size, &written, &format, binary.data());
+    if (written <= 0) return false;
+
+    Header h;
+    std::memcpy(h.magic, MAGIC, 4);
+    h.version = VERSION;
+    h.key = key;
+    h.binaryFormat = format;
+    h.binarySize = (uint32_t)written;
+    h.uniformCount = (uint32_t)program.Uniforms.size();
+    h.blockCount = (uint32_t)program.Ubos.size();
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "Cannot write shader cache " << path << std::endl;
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    out.write(binary.data(), written);
+    for (const auto& u : program.Uniforms) writeEntry(out, u.first, u.second.index);
+    for (const auto& b : program.Ubos) writeEntry(out, b.first, (GLint)b.second.index);
+    return (bool)out;
+}
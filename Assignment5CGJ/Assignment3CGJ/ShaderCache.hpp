@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "../mgl/mgl.hpp"
+
+// Linked program binaries on disk, next to the vertex shader as
+// <file>.<key>.pbin. The key hashes the final source of both stages (so
+// the #defines of a permutation too), the attribute bindings and the
+// driver's vendor, renderer and version strings: an edit, another variant
+// or a driver update each miss. An entry also keeps the uniform locations
+// and block indices found after linking, so a hit neither compiles, links
+// nor looks a name up. Drivers may still reject a binary they wrote; that
+// is a miss as well.
+namespace ShaderCache {
+
+// False when the driver offers no binary formats; every load then misses.
+bool supported();
+
+uint64_t key(const std::string& vertexSource, const std::string& fragmentSource,
+    const mgl::ShaderProgram& program);
+std::string path(const std::string& vertexFile, uint64_t key);
+
+// Loads the binary into program->ProgramId, fills in the index of every
+// declared uniform and block, and binds each block to its binding point.
+bool load(const std::string& path, uint64_t key, mgl::ShaderProgram* program);
+
+// Stores a linked program whose uniforms and blocks are resolved; it must
+// have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+bool store(const std::string& path, uint64_t key, const mgl::ShaderProgram& program);
+
+}
@@ -0,0 +1,235 @@
+#include "ShaderPermutations.hpp"
+#include "ShaderCache.hpp"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+ShaderPermutations::ShaderPermutations(const std::string& vertexFile, const std::string& fragmentFile,
+    const std::vector<std::string>& featureNames, Setup setup)
+    : vertexFile_(vertexFile), fragmentFile_(fragmentFile), featureNames_(featureNames), setup_(setup) {
+    parallel_ = GLEW_KHR_parallel_shader_compile != 0;
+    // As many compiler threads as the driver likes.
+    if (parallel_) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+    cacheable_ = GLEW_ARB_get_program_binary != 0 && ShaderCache::supported();
+}
+
+ShaderPermutations::~ShaderPermutations() {
+    for (auto& v : variants_) {
+        delete v.second.live.program;
+        delete v.second.reload.program;
+    }
+}
+
+mgl::ShaderProgram* ShaderPermutations::get(unsigned features) {
+    Variant* variant = start(features, true);
+    if (variant->live.state == BUILDING) finish(variant->live);
+    return variant->live.state == READY ? variant->live.program : nullptr;
+}
+
+void ShaderPermutations::prepare(unsigned features) {
+    start(features, false);
+}
+
+mgl::ShaderProgram* ShaderPermutations::ready(unsigned features) {
+    Variant* variant = start(features, false);
+    if (!variant) return get(features);
+    if (variant->live.state == BUILDING && completed(variant->live)) finish(variant->live);
+    return variant->live.state == READY ? variant->live.program : nullptr;
+}
+
+int ShaderPermutations::poll() {
+    int swapped = 0;
+    for (auto& v : variants_) {
+        Build& live = v.second.live;
+        Build& reload = v.second.reload;
+        if (live.state == BUILDING && completed(live)) finish(live);
+        if (!reload.program) continue;
+        if (reload.state == BUILDING) {
+            if (!completed(reload)) continue;
+            finish(reload);
+        }
+        if (reload.state == READY) {
+            // Its users keep the object; deleting `reload` frees the old program.
+            std::swap(live.program->ProgramId, reload.program->ProgramId);
+            std::swap(live.program->Uniforms, reload.program->Uniforms);
+            std::swap(live.program->Ubos, reload.program->Ubos);
+            live.key = reload.key;
+            swapped++;
+        }
+        delete reload.program;
+        reload = Build();
+    }
+    return swapped;
+}
+
+void ShaderPermutations::reload() {
+    for (auto it = variants_.begin(); it != variants_.end();) {
+        Variant& variant = it->second;
+        if (variant.live.state != READY) {
+            // Nobody holds it yet; it is started again on demand.
+            delete variant.live.program;
+            delete variant.reload.program;
+            it = variants_.erase(it);
+            continue;
+        }
+        delete variant.reload.program;
+        variant.reload = Build();
+        begin(variant.reload, it->first, true);
+        ++it;
+    }
+}
+
+bool ShaderPermutations::building(unsigned features) const {
+    auto it = variants_.find(features);
+    return it != variants_.end() && it->second.live.state == BUILDING;
+}
+
+bool ShaderPermutations::reloading() const {
+    for (const auto& v : variants_) {
+        if (v.second.reload.program) return true;
+    }
+    return false;
+}
+
+ShaderPermutations::Variant* ShaderPermutations::start(unsigned features, bool wait) {
+    auto it = variants_.find(features);
+    if (it != variants_.end()) return &it->second;
+
+    Variant variant;
+    if (!begin(variant.live, features, wait)) return nullptr;
+    return &(variants_[features] = variant);
+}
+
+bool ShaderPermutations::begin(Build& build, unsigned features, bool wait) {
+    std::string vertexSource = source(vertexFile_, features);
+    std::string fragmentSource = source(fragmentFile_, features);
+    mgl::ShaderProgram* program = new mgl::ShaderProgram();
+    setup_(program, features);
+    build.program = program;
+    if (vertexSource.empty() || fragmentSource.empty()) {
+        build.state = FAILED;
+        return true;
+    }
+
+    build.key = ShaderCache::key(vertexSource, fragmentSource, *program);
+    if (cacheable_ && ShaderCache::load(ShaderCache::path(vertexFile_, build.key), build.key, program)) {
+        build.state = READY;
+        cacheHits_++;
+        return true;
+    }
+    if (!wait && !parallel_) {
+        delete program;
+        build = Build();
+        return false;
+    }
+
+    // No status query until finish(): with the parallel compile extension
+    // the driver compiles and links on its own threads meanwhile.
+    std::string defines;
+    for (size_t i = 0; i < featureNames_.size(); i++) {
+        if (features & (1u << i)) defines += " " + featureNames_[i];
+    }
+    compile(program, GL_VERTEX_SHADER, vertexFile_ + defines, vertexSource);
+    compile(program, GL_FRAGMENT_SHADER, fragmentFile_ + defines, fragmentSource);
+    for (const auto& a : program->Attributes) {
+        glBindAttribLocation(program->ProgramId, a.second.index, a.first.c_str());
+    }
+    if (cacheable_) glProgramParameteri(program->ProgramId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glLinkProgram(program->ProgramId);
+    build.state = BUILDING;
+    return true;
+}
+
+// Without the parallel compile extension the link has finished on return.
+bool ShaderPermutations::completed(const Build& build) const {
+    if (!parallel_) return true;
+    GLint done = GL_FALSE;
+    glGetProgramiv(build.program->ProgramId, GL_COMPLETION_STATUS_KHR, &done);
+    return done != GL_FALSE;
+}
+
+// What mgl::ShaderProgram::create() does after linking, plus storing the
+// binary.
+void ShaderPermutations::finish(Build& build) {
+    mgl::ShaderProgram* program = build.program;
+    GLint linked = GL_FALSE;
+    glGetProgramiv(program->ProgramId, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE) {
+        for (const auto& s : program->Shaders) {
+            GLint compiled = GL_FALSE;
+            glGetShaderiv(s.second.index, GL_COMPILE_STATUS, &compiled);
+            if (compiled == GL_TRUE) continue;
+            GLint length = 0;
+            glGetShaderiv(s.second.index, GL_INFO_LOG_LENGTH, &length);
+            std::string log(length > 0 ? length : 1, '\0');
+            glGetShaderInfoLog(s.second.index, (GLsizei)log.size(), nullptr, &log[0]);
+            std::cerr << "Shader " << s.first << " failed to compile:" << std::endl << log.c_str() << std::endl;
+        }
+        GLint length = 0;
+        glGetProgramiv(program->ProgramId, GL_INFO_LOG_LENGTH, &length);
+        std::string log(length > 0 ? length : 1, '\0');
+        glGetProgramInfoLog(program->ProgramId, (GLsizei)log.size(), nullptr, &log[0]);
+        std::cerr << "Shader program " << vertexFile_ << " failed to link:" << std::endl << log.c_str() << std::endl;
+        build.state = FAILED;
+    }
+    else {
+        for (auto& u : program->Uniforms) {
+            u.second.index = glGetUniformLocation(program->ProgramId, u.first.c_str());
+        }
+        for (auto& b : program->Ubos) {
+            b.second.index = glGetUniformBlockIndex(program->ProgramId, b.first.c_str());
+            if (b.second.index != GL_INVALID_INDEX) {
+                glUniformBlockBinding(program->ProgramId, b.second.index, b.second.binding_point);
+            }
+        }
+        build.state = READY;
+        compiled_++;
+    }
+
+    for (const auto& s : program->Shaders) {
+        glDetachShader(program->ProgramId, s.second.index);
+        glDeleteShader(s.second.index);
+    }
+    program->Shaders.clear();
+    if (build.state == READY && cacheable_) {
+        ShaderCache::store(ShaderCache::path(vertexFile_, build.key), build.key, *program);
+    }
+}
+
+std::string ShaderPermutations::source(const std::string& filename, unsigned features) const {
+    std::ifstream file(filename);
+    if (!file) {
+        std::cerr << "Cannot read shader " << filename << std::endl;
+        return std::string();
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string source = buffer.str();
+
+    // #version must stay the first statement.
+    std::string block;
+    for (size_t i = 0; i < featureNames_.size(); i++) {
+        if (features & (1u << i)) block += "#define " + featureNames_[i] + "\n";
+    }
+    size_t at = 0;
+    size_t version = source.find("#version");
+    if (version != std::string::npos) {
+        size_t eol = source.find('\n', version);
+        at = eol == std::string::npos ? source.size() : eol + 1;
+        if (eol == std::string::npos) block = "\n" + block;
+    }
+    source.insert(at, block);
+    return source;
+}
+
+// Registered in Shaders under a name per variant, for the error report and
+// so finish() can detach and delete them.
+void ShaderPermutations::compile(mgl::ShaderProgram* program, GLenum type, const std::string& name,
+    const std::string& source) {
+    GLuint shaderId = glCreateShader(type);
+    const GLchar* code = source.c_str();
+    glShaderSource(shaderId, 1, &code, nullptr);
+    glCompileShader(shaderId);
+    glAttachShader(program->ProgramId, shaderId);
+    program->Shaders[name] = { shaderId };
+}
@@ -0,0 +1,99 @@
+#pragma once
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+#include "../mgl/mgl.hpp"
+
+// Variants of one vertex/fragment shader pair, built on first use. A
+// variant is a bit set of features; bit i adds `#define <featureNames[i]>`
+// right after the #version line of both stages, so one set of .glsl files
+// serves every combination.
+//
+// Linked variants are kept in the ShaderCache and loaded from there on
+// later runs. A variant missing from it is compiled and linked without
+// waiting for the result where the driver has GL_KHR_parallel_shader_compile;
+// poll() picks it up once the driver's threads are done. Variants are
+// linked here rather than by mgl::ShaderProgram::create(), which would
+// block on the link status.
+//
+// reload() rebuilds every variant from the current sources the same way,
+// and poll() moves each rebuilt program into the mgl::ShaderProgram its
+// users already hold, so nothing has to be looked up again but the uniform
+// locations. A variant that no longer compiles keeps its old program.
+class ShaderPermutations {
+public:
+    // Declares attributes, uniforms and blocks on a new program before it
+    // is linked; it gets the feature bits, since a variant may use fewer.
+    typedef std::function<void(mgl::ShaderProgram* program, unsigned features)> Setup;
+
+    ShaderPermutations(const std::string& vertexFile, const std::string& fragmentFile,
+        const std::vector<std::string>& featureNames, Setup setup);
+    ~ShaderPermutations();
+
+    // The variant, waiting for it if need be; nullptr if it failed to build.
+    mgl::ShaderProgram* get(unsigned features);
+
+    // Starts building a variant and returns at once. Without the parallel
+    // compile extension a cache miss is left to get().
+    void prepare(unsigned features);
+
+    // The variant if it is built, otherwise nullptr (and it is prepared).
+    // Without the parallel compile extension this is get().
+    mgl::ShaderProgram* ready(unsigned features);
+
+    // Finishes the variants whose background link has completed. Returns
+    // the number of reloaded variants swapped in, whose uniform locations
+    // may have moved.
+    int poll();
+
+    // Rebuilds every variant, after one of the sources changed.
+    void reload();
+
+    bool building(unsigned features) const;
+    bool reloading() const;
+    bool uses(const std::string& filename) const { return filename == vertexFile_ || filename == fragmentFile_; }
+    const std::string& vertexFile() const { return vertexFile_; }
+    const std::string& fragmentFile() const { return fragmentFile_; }
+
+    int cacheHits() const { return cacheHits_; }
+    int compiledCount() const { return compiled_; }
+
+private:
+    enum State { BUILDING, READY, FAILED };
+
+    struct Build {
+        mgl::ShaderProgram* program = nullptr;
+        State state = BUILDING;
+        uint64_t key = 0;
+    };
+
+    // `reload` holds a program only while it is rebuilt.
+    struct Variant {
+        Build live;
+        Build reload;
+    };
+
+    std::string vertexFile_;
+    std::string fragmentFile_;
+    std::vector<std::string> featureNames_;
+    Setup setup_;
+    std::map<unsigned, Variant> variants_;
+    bool parallel_ = false;
+    bool cacheable_ = false;
+    int cacheHits_ = 0;
+    int compiled_ = 0;
+
+    // Null when a miss would have to be compiled and `wait` is false.
+    Variant* start(unsigned features, bool wait);
+    // False, with no program made, when a miss would have to be compiled
+    // and `wait` is false.
+    bool begin(Build& build, unsigned features, bool wait);
+    bool completed(const Build& build) const;
+    void finish(Build& build);
+
+    // The source with the variant's #defines; empty if it cannot be read.
+    std::string source(const std::string& filename, unsigned features) const;
+    static void compile(mgl::ShaderProgram* program, GLenum type, const std::string& name,
+        const std::string& source);
+};
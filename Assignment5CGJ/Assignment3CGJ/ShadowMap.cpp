@@ -0,0 +1,236 @@
+#include "ShadowMap.hpp"
+#include <algorithm>
+#include "Frustum.hpp"
+
+// Near plane of the six face projections.
+static const float NEAR_PLANE = 0.05f;
+
+ShadowMap::~ShadowMap() {
+    release();
+}
+
+void ShadowMap::release() {
+    if (staticCube_) {
+        GLuint cubes[2] = { staticCube_, dynamicCube_ };
+        glDeleteTextures(2, cubes);
+        glDeleteFramebuffers(1, &framebuffer_);
+    }
+    staticCube_ = dynamicCube_ = framebuffer_ = 0;
+    delete program_;
+    program_ = nullptr;
+    invalidate();
+}
+
+void ShadowMap::create() {
+    release();
+    program_ = new mgl::ShaderProgram();
+    program_->addShader(GL_VERTEX_SHADER, "shadow-vs.glsl");
+    program_->addShader(GL_FRAGMENT_SHADER, "shadow-fs.glsl");
+    program_->addAttribute(mgl::POSITION_ATTRIBUTE, mgl::Mesh::POSITION);
+    program_->addUniform(mgl::MODEL_MATRIX);
+    program_->addUniform("FaceMatrix");
+    program_->addUniform("uLightPos");
+    program_->addUniform("uRadius");
+    program_->create();
+    modelMatrixId_ = program_->Uniforms[mgl::MODEL_MATRIX].index;
+    faceMatrixId_ = program_->Uniforms["FaceMatrix"].index;
+    lightPosId_ = program_->Uniforms["uLightPos"].index;
+    radiusId_ = program_->Uniforms["uRadius"].index;
+
+    // Filtered lookups across face edges, and hardware-compared samples.
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+    GLuint cubes[2];
+    glGenTextures(2, cubes);
+    for (GLuint cube : cubes) {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cube);
+        glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, GL_DEPTH_COMPONENT32F, SIZE, SIZE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    }
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    staticCube_ = cubes[0];
+    dynamicCube_ = cubes[1];
+
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void ShadowMap::invalidate() {
+    valid_ = false;
+    static_.clear();
+    dynamic_.clear();
+    sampleDynamic_ = false;
+}
+
+void ShadowMap::bind() const {
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, sampleDynamic_ ? dynamicCube_ : staticCube_);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+// Closest point of the mesh's world box within the radius.
+bool ShadowMap::inRange(const Scene& scene, int index) const {
+    const MeshBuffers* mesh = scene.mesh(index);
+    const AABB& box = scene.meshBounds(index);
+    if (!mesh || !mesh->ready() || box.isEmpty()) return false;
+    glm::vec3 closest = glm::clamp(position_, box.min, box.max);
+    glm::vec3 d = closest - position_;
+    return glm::dot(d, d) <= radius_ * radius_;
+}
+
+// An edited caster in the cached cube has to leave it; one that is not in
+// it only matters if it is within range now.
+void ShadowMap::trackEdits(const Scene& scene, const mgl::SceneNode* owner) {
+    for (const mgl::SceneNode* edited : edits_) {
+        int root = scene.indexOf(edited);
+        if (root < 0) continue;
+        for (int i = root; i < root + scene.subtreeSize(root); i++) {
+            const mgl::SceneNode* node = scene.node(i);
+            if (node == owner || !scene.mesh(i)) continue;
+            auto it = dynamic_.find(node);
+            if (it != dynamic_.end()) {
+                it->second = 0;
+                continue;
+            }
+            if (static_.erase(node)) valid_ = false;
+            else if (!inRange(scene, i)) continue;
+            dynamic_.emplace(node, 0);
+        }
+    }
+}
+
+void ShadowMap::update(Scene& scene, const glm::vec3& position, float radius, const mgl::SceneNode* owner) {
+    faces_ = 0;
+    casters_ = 0;
+    staticRendered_ = false;
+    scene.takeEdits(edits_);
+    if (!program_) return;
+
+    // The cubes are centred on the light, so a move redraws everything.
+    if (!valid_ || position != position_ || radius != radius_) {
+        invalidate();
+        position_ = position;
+        radius_ = radius;
+    }
+    else {
+        trackEdits(scene, owner);
+    }
+
+    for (auto it = dynamic_.begin(); it != dynamic_.end();) {
+        int index = scene.indexOf(it->first);
+        if (index >= 0 && ++it->second < SETTLE_FRAMES) {
+            ++it;
+            continue;
+        }
+        if (index >= 0 && inRange(scene, index)) valid_ = false;
+        it = dynamic_.erase(it);
+    }
+
+    if (!valid_) {
+        static_.clear();
+        candidates_.clear();
+        scene.spatialIndex().query(Sphere{ position_, radius_ }, candidates_);
+        // In node order, so the draws come in the same order every time.
+        std::sort(candidates_.begin(), candidates_.end());
+        drawList_.clear();
+        for (int i : candidates_) {
+            const mgl::SceneNode* node = scene.node(i);
+            if (node == owner || !inRange(scene, i) || dynamic_.count(node)) continue;
+            static_.insert(node);
+            drawList_.push_back(i);
+        }
+        render(staticCube_, scene, drawList_, true);
+        valid_ = true;
+        staticRendered_ = true;
+    }
+
+    drawList_.clear();
+    for (const auto& d : dynamic_) {
+        int index = scene.indexOf(d.first);
+        if (inRange(scene, index)) drawList_.push_back(index);
+    }
+    std::sort(drawList_.begin(), drawList_.end());
+    sampleDynamic_ = !drawList_.empty();
+    if (sampleDynamic_) {
+        glCopyImageSubData(staticCube_, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0, dynamicCube_, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+            SIZE, SIZE, 6);
+        render(dynamicCube_, scene, drawList_, false);
+    }
+}
+
+// Projection * view of a cube face, in the GL face order and orientation.
+glm::mat4 ShadowMap::faceMatrix(int face) const {
+    static const glm::vec3 directions[6] = {
+        { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+    };
+    static const glm::vec3 ups[6] = {
+        { 0, -1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 }, { 0, -1, 0 }, { 0, -1, 0 },
+    };
+    glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, NEAR_PLANE, radius_);
+    return projection * glm::lookAt(position_, position_ + directions[face], ups[face]);
+}
+
+// Coarsest level whose error stays below a shadow map texel at the mesh's
+// distance from the light.
+static unsigned shadowLevel(const MeshBuffers* mesh, const glm::mat4& world, const AABB& box,
+    const glm::vec3& light) {
+    glm::vec3 d = glm::clamp(light, box.min, box.max) - light;
+    float texel = 2.0f * glm::length(d) / ShadowMap::SIZE;
+    float scale = std::max(std::max(glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1]))),
+        glm::length(glm::vec3(world[2])));
+    unsigned level = 0;
+    for (unsigned l = 1; l < mesh->lodCount(); l++) {
+        if (mesh->lod(l).error * scale <= texel) level = l;
+    }
+    return level;
+}
+
+void ShadowMap::render(GLuint cube, const Scene& scene, const std::vector<int>& nodes, bool clear) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLboolean cullFace = glIsEnabled(GL_CULL_FACE);
+    glDisable(GL_CULL_FACE);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glViewport(0, 0, SIZE, SIZE);
+    program_->bind();
+    glUniform3fv(lightPosId_, 1, glm::value_ptr(position_));
+    glUniform1f(radiusId_, radius_);
+
+    for (int face = 0; face < 6; face++) {
+        glm::mat4 faceMatrix = this->faceMatrix(face);
+        Frustum frustum(faceMatrix);
+        bool attached = false;
+        auto attach = [&]() {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, cube, 0);
+            if (clear) glClear(GL_DEPTH_BUFFER_BIT);
+            glUniformMatrix4fv(faceMatrixId_, 1, GL_FALSE, glm::value_ptr(faceMatrix));
+            attached = true;
+            faces_++;
+        };
+        if (clear) attach();
+        for (int index : nodes) {
+            if (frustum.test(scene.meshBounds(index)) == Frustum::OUTSIDE) continue;
+            if (!attached) attach();
+            const MeshBuffers* mesh = scene.mesh(index);
+            const glm::mat4& world = scene.world(index);
+            glUniformMatrix4fv(modelMatrixId_, 1, GL_FALSE, glm::value_ptr(world));
+            mesh->bindVertexArray();
+            mesh->drawElements(shadowLevel(mesh, world, scene.meshBounds(index), position_));
+            casters_++;
+        }
+    }
+
+    glBindVertexArray(0);
+    program_->unbind();
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    if (cullFace) glEnable(GL_CULL_FACE);
+}
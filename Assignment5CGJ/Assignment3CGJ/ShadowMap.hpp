@@ -0,0 +1,87 @@
+#pragma once
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../mgl/mgl.hpp"
+#include "../mgl/mglSceneNode.hpp"
+#include "Scene.hpp"
+
+// Omnidirectional shadows for one point light: a depth cube map holding,
+// per direction, the distance from the light to the nearest caster over the
+// light's radius, which a5-fs.glsl compares against when SHADOWS is defined.
+// Only meshes within the radius cast.
+//
+// The static casters are rendered into a cached cube, redone only when the
+// light moves or the set of static casters changes. A node that is edited
+// (Scene::takeEdits()) leaves that set and becomes dynamic: every frame the
+// cached cube is copied into a second one and the dynamic casters are drawn
+// over the faces they touch. After SETTLE_FRAMES without edits the node
+// rejoins the cached cube. Dragging a node therefore costs two cached
+// renders plus a cheap pass per frame, and a scene where nothing moves near
+// the light costs nothing at all.
+class ShadowMap {
+public:
+    static const int SIZE = 512;
+    static const GLint TEXTURE_UNIT = 4;
+    static const int SETTLE_FRAMES = 15;
+
+    ~ShadowMap();
+
+    // Loads the depth shader and makes the cube maps; call with a current
+    // context.
+    void create();
+
+    // Frees the GL objects; create() makes them again.
+    void release();
+
+    // Brings the sampled cube up to date for a light at `position`; call
+    // after Scene::update(). Takes the scene's edits. `owner`, the node carrying the light, does not
+    // cast (it would enclose the light).
+    void update(Scene& scene, const glm::vec3& position, float radius, const mgl::SceneNode* owner);
+
+    // Renders everything again on the next update(); call when the scene is
+    // rebuilt, or after frames in which update() was not called.
+    void invalidate();
+
+    // Binds the cube the last update() produced to TEXTURE_UNIT.
+    void bind() const;
+
+    // Casters still settling; the app keeps drawing frames until they have.
+    bool settling() const { return !dynamic_.empty(); }
+
+    // Work done by the last update().
+    int facesRendered() const { return faces_; }
+    int castersDrawn() const { return casters_; }
+    bool staticRendered() const { return staticRendered_; }
+
+private:
+    mgl::ShaderProgram* program_ = nullptr;
+    GLint modelMatrixId_ = -1;
+    GLint faceMatrixId_ = -1;
+    GLint lightPosId_ = -1;
+    GLint radiusId_ = -1;
+    GLuint staticCube_ = 0;
+    GLuint dynamicCube_ = 0;
+    GLuint framebuffer_ = 0;
+
+    bool valid_ = false;
+    glm::vec3 position_;
+    float radius_ = 0.0f;
+    std::unordered_set<const mgl::SceneNode*> static_;     // in the cached cube
+    std::unordered_map<const mgl::SceneNode*, int> dynamic_;  // frames since the last edit
+    std::vector<const mgl::SceneNode*> edits_;
+    std::vector<int> drawList_;
+    std::vector<int> candidates_;
+    bool sampleDynamic_ = false;
+
+    int faces_ = 0;
+    int casters_ = 0;
+    bool staticRendered_ = false;
+
+    bool inRange(const Scene& scene, int index) const;
+    void trackEdits(const Scene& scene, const mgl::SceneNode* owner);
+    glm::mat4 faceMatrix(int face) const;
+    // Draws `nodes` into the faces of `cube` they reach; `clear` starts from
+    // empty faces, otherwise only faces with something to draw are touched.
+    void render(GLuint cube, const Scene& scene, const std::vector<int>& nodes, bool clear);
+};
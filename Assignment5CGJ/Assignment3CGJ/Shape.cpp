@@ -24,6 +24,7 @@ Shape::Shape(const std::vector<glm::vec4>& points,
 }
 
 Shape::~Shape() {
+    delete Mesh;
     glBindVertexArray(VaoId);
     glDeleteVertexArrays(1, &VaoId);
     glDeleteBuffers(2, VboId);
@@ -98,6 +99,7 @@ void Shape::draw(GLint matrixUniform, GLint colorUniform, glm::vec3 pos, float r
 void Shape::createMesh(std::string mesh_file) {
     //Handles creating a mesh, but i dont know if its a single mesh per shape
     std::string mesh_fullname = mesh_dir + mesh_file;
+    delete Mesh;
     Mesh = new mgl::Mesh();
     Mesh->joinIdenticalVertices();
     Mesh->create(mesh_fullname);
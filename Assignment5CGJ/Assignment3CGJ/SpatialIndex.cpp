@@ -0,0 +1,299 @@
+#include "SpatialIndex.hpp"
+#include <algorithm>
+
+// Enlargement per side, as a fraction of the box's largest extent, with a
+// floor for small boxes.
+static const float MARGIN = 0.1f;
+static const float MIN_MARGIN = 0.05f;
+
+// A proxy is also inserted again when its enlarged box has grown this many
+// times the area a fresh one would have (e.g. after scaling a node down).
+static const float MAX_SLACK = 4.0f;
+
+static AABB merge(const AABB& a, const AABB& b) {
+    AABB r = a;
+    r.expand(b);
+    return r;
+}
+
+static bool contains(const AABB& outer, const AABB& inner) {
+    return glm::all(glm::lessThanEqual(outer.min, inner.min)) && glm::all(glm::lessThanEqual(inner.max, outer.max));
+}
+
+static bool overlaps(const AABB& a, const AABB& b) {
+    return glm::all(glm::lessThanEqual(a.min, b.max)) && glm::all(glm::lessThanEqual(b.min, a.max));
+}
+
+static bool overlaps(const AABB& box, const Sphere& sphere) {
+    glm::vec3 d = glm::clamp(sphere.center, box.min, box.max) - sphere.center;
+    return glm::dot(d, d) <= sphere.radius * sphere.radius;
+}
+
+AABB SpatialIndex::fatten(const AABB& box) {
+    glm::vec3 e = box.extent();
+    float margin = std::max(MARGIN * std::max(std::max(e.x, e.y), e.z), MIN_MARGIN);
+    AABB r;
+    r.min = box.min - glm::vec3(margin);
+    r.max = box.max + glm::vec3(margin);
+    return r;
+}
+
+int SpatialIndex::allocate() {
+    if (free_ < 0) {
+        nodes_.emplace_back();
+        return (int)nodes_.size() - 1;
+    }
+    int id = free_;
+    free_ = nodes_[id].parent;
+    nodes_[id] = Node();
+    return id;
+}
+
+void SpatialIndex::release(int id) {
+    nodes_[id].height = -1;
+    nodes_[id].parent = free_;
+    free_ = id;
+}
+
+int SpatialIndex::insert(const AABB& box, int data) {
+    int leaf = allocate();
+    nodes_[leaf].box = fatten(box);
+    nodes_[leaf].data = data;
+    insertLeaf(leaf);
+    count_++;
+    return leaf;
+}
+
+void SpatialIndex::remove(int proxy) {
+    removeLeaf(proxy);
+    release(proxy);
+    count_--;
+}
+
+bool SpatialIndex::move(int proxy, const AABB& box) {
+    const AABB& fat = nodes_[proxy].box;
+    AABB fresh = fatten(box);
+    if (contains(fat, box) && fat.surfaceArea() <= MAX_SLACK * fresh.surfaceArea()) return false;
+    removeLeaf(proxy);
+    nodes_[proxy].box = fresh;
+    insertLeaf(proxy);
+    return true;
+}
+
+void SpatialIndex::clear() {
+    nodes_.clear();
+    root_ = -1;
+    free_ = -1;
+    count_ = 0;
+}
+
+// Walks down to the sibling that adds the least surface area, counting
+// what every ancestor on the way grows by as well.
+void SpatialIndex::insertLeaf(int leaf) {
+    if (root_ < 0) {
+        root_ = leaf;
+        nodes_[leaf].parent = -1;
+        return;
+    }
+
+    const AABB box = nodes_[leaf].box;
+    int index = root_;
+    while (!nodes_[index].isLeaf()) {
+        const Node& node = nodes_[index];
+        float area = node.box.surfaceArea();
+        float combinedArea = merge(node.box, box).surfaceArea();
+        // Cost of a new parent for this node and the leaf, and the growth
+        // every ancestor below here pays for the leaf either way.
+        float cost = 2.0f * combinedArea;
+        float inherited = 2.0f * (combinedArea - area);
+        auto descend = [&](int child) {
+            const AABB& b = nodes_[child].box;
+            float grown = merge(b, box).surfaceArea();
+            return (nodes_[child].isLeaf() ? grown : grown - b.surfaceArea()) + inherited;
+        };
+        float leftCost = descend(node.left);
+        float rightCost = descend(node.right);
+        if (cost < leftCost && cost < rightCost) break;
+        index = leftCost < rightCost ? node.left : node.right;
+    }
+
+    int sibling = index;
+    int oldParent = nodes_[sibling].parent;
+    int parent = allocate();
+    nodes_[parent].parent = oldParent;
+    nodes_[parent].box = merge(box, nodes_[sibling].box);
+    nodes_[parent].height = nodes_[sibling].height + 1;
+    nodes_[parent].left = sibling;
+    nodes_[parent].right = leaf;
+    nodes_[sibling].parent = parent;
+    nodes_[leaf].parent = parent;
+    if (oldParent < 0) root_ = parent;
+    else if (nodes_[oldParent].left == sibling) nodes_[oldParent].left = parent;
+    else nodes_[oldParent].right = parent;
+
+    refit(nodes_[leaf].parent);
+}
+
+void SpatialIndex::removeLeaf(int leaf) {
+    if (leaf == root_) {
+        root_ = -1;
+        return;
+    }
+    int parent = nodes_[leaf].parent;
+    int grandParent = nodes_[parent].parent;
+    int sibling = nodes_[parent].left == leaf ? nodes_[parent].right : nodes_[parent].left;
+    release(parent);
+    nodes_[sibling].parent = grandParent;
+    if (grandParent < 0) {
+        root_ = sibling;
+        return;
+    }
+    if (nodes_[grandParent].left == parent) nodes_[grandParent].left = sibling;
+    else nodes_[grandParent].right = sibling;
+    refit(grandParent);
+}
+
+// Balances, then recomputes box and height, from `index` up to the root.
+void SpatialIndex::refit(int index) {
+    while (index >= 0) {
+        index = balance(index);
+        Node& node = nodes_[index];
+        const Node& left = nodes_[node.left];
+        const Node& right = nodes_[node.right];
+        node.box = merge(left.box, right.box);
+        node.height = 1 + std::max(left.height, right.height);
+        index = node.parent;
+    }
+}
+
+// If one child of `a` is more than one level taller than the other, that
+// child takes a's place and a takes the taller of its children's places.
+// Returns the node now at a's position.
+int SpatialIndex::balance(int a) {
+    Node& A = nodes_[a];
+    if (A.isLeaf() || A.height < 2) return a;
+
+    int b = A.left;
+    int c = A.right;
+    int diff = nodes_[c].height - nodes_[b].height;
+    if (diff >= -1 && diff <= 1) return a;
+
+    // `up` is the taller child, `stay` the other; `up` moves above a.
+    bool rightHeavy = diff > 1;
+    int up = rightHeavy ? c : b;
+    int stay = rightHeavy ? b : c;
+    Node& U = nodes_[up];
+    int f = U.left;
+    int g = U.right;
+
+    U.left = a;
+    U.parent = A.parent;
+    A.parent = up;
+    if (U.parent < 0) root_ = up;
+    else if (nodes_[U.parent].left == a) nodes_[U.parent].left = up;
+    else nodes_[U.parent].right = up;
+
+    // The taller grandchild stays with `up`; the other goes to a.
+    int keep = nodes_[f].height > nodes_[g].height ? f : g;
+    int give = keep == f ? g : f;
+    U.right = keep;
+    if (rightHeavy) A.right = give;
+    else A.left = give;
+    nodes_[give].parent = a;
+
+    A.box = merge(nodes_[stay].box, nodes_[give].box);
+    A.height = 1 + std::max(nodes_[stay].height, nodes_[give].height);
+    U.box = merge(A.box, nodes_[keep].box);
+    U.height = 1 + std::max(A.height, nodes_[keep].height);
+    return up;
+}
+
+void SpatialIndex::collect(int index, std::vector<int>& result) const {
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = index;
+    while (top > 0) {
+        const Node& node = nodes_[stack[--top]];
+        if (node.isLeaf()) {
+            result.push_back(node.data);
+            continue;
+        }
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+    }
+}
+
+void SpatialIndex::query(const AABB& box, std::vector<int>& result) const {
+    if (root_ < 0 || box.isEmpty()) return;
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = root_;
+    while (top > 0) {
+        const Node& node = nodes_[stack[--top]];
+        if (!overlaps(node.box, box)) continue;
+        if (node.isLeaf()) {
+            result.push_back(node.data);
+            continue;
+        }
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+    }
+}
+
+void SpatialIndex::query(const Sphere& sphere, std::vector<int>& result) const {
+    if (root_ < 0 || sphere.isEmpty()) return;
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = root_;
+    while (top > 0) {
+        const Node& node = nodes_[stack[--top]];
+        if (!overlaps(node.box, sphere)) continue;
+        if (node.isLeaf()) {
+            result.push_back(node.data);
+            continue;
+        }
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+    }
+}
+
+// A subtree found fully inside is collected without further tests.
+void SpatialIndex::query(const Frustum& frustum, std::vector<int>& result) const {
+    if (root_ < 0) return;
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = root_;
+    while (top > 0) {
+        int index = stack[--top];
+        const Node& node = nodes_[index];
+        Frustum::Result test = frustum.test(node.box);
+        if (test == Frustum::OUTSIDE) continue;
+        if (test == Frustum::INSIDE || node.isLeaf()) {
+            collect(index, result);
+            continue;
+        }
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+    }
+}
+
+void SpatialIndex::raycast(const Ray& ray, float tMax, std::vector<RayHit>& result) const {
+    size_t first = result.size();
+    if (root_ < 0) return;
+    int stack[STACK_SIZE];
+    int top = 0;
+    stack[top++] = root_;
+    while (top > 0) {
+        const Node& node = nodes_[stack[--top]];
+        float t;
+        if (!ray.intersects(node.box, tMax, t)) continue;
+        if (node.isLeaf()) {
+            result.push_back({ node.data, t });
+            continue;
+        }
+        stack[top++] = node.right;
+        stack[top++] = node.left;
+    }
+    std::sort(result.begin() + first, result.end(),
+        [](const RayHit& a, const RayHit& b) { return a.distance < b.distance; });
+}
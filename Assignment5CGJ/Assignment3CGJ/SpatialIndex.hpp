@@ -0,0 +1,75 @@
+#pragma once
+#include <vector>
+#include "Bounds.hpp"
+#include "Frustum.hpp"
+
+// Dynamic bounding volume tree over boxes that move (after Box2D's
+// b2DynamicTree). Every leaf stores a box enlarged by a margin, so a box
+// that moves a little still fits and needs no update; one that leaves its
+// enlarged box is taken out and inserted again, next to the sibling that
+// grows the tree's surface area least. Rotations keep the tree balanced, so
+// insert, move and remove cost O(log n), as does a query that finds few
+// boxes.
+//
+// Each box carries an int (Scene stores the node index); queries append
+// the ints of the boxes they find. Results are conservative: they test the
+// enlarged boxes, and the caller tests its exact bounds if it needs to.
+class SpatialIndex {
+public:
+    // Returns the proxy id the other calls take.
+    int insert(const AABB& box, int data);
+    void remove(int proxy);
+    // False when the box still fits the proxy's enlarged box.
+    bool move(int proxy, const AABB& box);
+    void clear();
+
+    void setData(int proxy, int data) { nodes_[proxy].data = data; }
+    int data(int proxy) const { return nodes_[proxy].data; }
+    const AABB& fatBounds(int proxy) const { return nodes_[proxy].box; }
+
+    size_t size() const { return count_; }
+    int height() const { return root_ < 0 ? 0 : nodes_[root_].height; }
+
+    void query(const AABB& box, std::vector<int>& result) const;
+    void query(const Sphere& sphere, std::vector<int>& result) const;
+    void query(const Frustum& frustum, std::vector<int>& result) const;
+
+    struct RayHit {
+        int data;
+        float distance;     // where the ray enters the enlarged box
+    };
+    // Boxes the ray enters before tMax, nearest first. A caller after the
+    // nearest surface can stop at the first entry beyond its best hit.
+    void raycast(const Ray& ray, float tMax, std::vector<RayHit>& result) const;
+
+private:
+    // Leaves have left == -1. Free nodes are chained through parent.
+    struct Node {
+        AABB box;
+        int parent = -1;
+        int left = -1;
+        int right = -1;
+        int height = 0;
+        int data = -1;
+
+        bool isLeaf() const { return left < 0; }
+    };
+
+    // Enough for any tree that fits in memory: a balanced tree's height is
+    // under 1.45 log2(n), and a query keeps at most height + 1 on its stack.
+    static const int STACK_SIZE = 96;
+
+    std::vector<Node> nodes_;
+    int root_ = -1;
+    int free_ = -1;
+    size_t count_ = 0;
+
+    int allocate();
+    void release(int id);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    void refit(int index);
+    int balance(int index);
+    void collect(int index, std::vector<int>& result) const;
+    static AABB fatten(const AABB& box);
+};
@@ -0,0 +1,82 @@
+#include "StreamBuffer.hpp"
+#include <algorithm>
+
+StreamBuffer::~StreamBuffer() {
+    release();
+}
+
+void StreamBuffer::release() {
+    for (GLsync& f : fences_) {
+        if (f) glDeleteSync(f);
+        f = nullptr;
+    }
+    if (bufferId_) {
+        if (mapped_) {
+            glBindBuffer(GL_ARRAY_BUFFER, bufferId_);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        // The driver keeps the storage alive until draws that use it finish.
+        glDeleteBuffers(1, &bufferId_);
+    }
+    bufferId_ = 0;
+    mapped_ = nullptr;
+}
+
+void StreamBuffer::allocate(size_t regionSize) {
+    release();
+    // Offsets stay aligned for any attribute type.
+    regionSize_ = (regionSize + 255) & ~(size_t)255;
+    size_t total = regionSize_ * REGIONS;
+
+    glGenBuffers(1, &bufferId_);
+    glBindBuffer(GL_ARRAY_BUFFER, bufferId_);
+    if (GLEW_ARB_buffer_storage) {
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, total, nullptr, flags);
+        mapped_ = static_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, total, flags));
+    }
+    if (!mapped_) {
+        glBufferData(GL_ARRAY_BUFFER, total, nullptr, GL_STREAM_DRAW);
+        staging_.resize(regionSize_);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void* StreamBuffer::begin(size_t bytes) {
+    if (!bufferId_ || bytes > regionSize_) {
+        allocate(std::max({ bytes, regionSize_ * 2, (size_t)64 * 1024 }));
+    }
+    region_ = (region_ + 1) % REGIONS;
+    used_ = bytes;
+
+    GLsync& f = fences_[region_];
+    if (f) {
+        GLenum status = glClientWaitSync(f, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            waits_++;
+            do {
+                status = glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(f);
+        f = nullptr;
+    }
+    return mapped_ ? mapped_ + region_ * regionSize_ : staging_.data();
+}
+
+size_t StreamBuffer::end() {
+    size_t offset = region_ * regionSize_;
+    if (!mapped_ && used_ > 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, bufferId_);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, used_, staging_.data());
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    return offset;
+}
+
+void StreamBuffer::fence() {
+    GLsync& f = fences_[region_];
+    if (f) glDeleteSync(f);
+    f = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
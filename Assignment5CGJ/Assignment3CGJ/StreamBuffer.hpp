@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <GL/glew.h>
+#include <vector>
+
+// Ring of REGIONS equal regions in one vertex buffer, for data rewritten
+// every frame. Where GL_ARB_buffer_storage is available the buffer is
+// mapped once, persistently and coherently, and callers write straight into
+// it; otherwise writes go to CPU memory and are copied with one
+// glBufferSubData. Either way a region is only reused after the fence
+// placed behind its last draws has signalled, so writes never stall on
+// draws still in flight and the driver needs no implicit synchronisation.
+//
+// Use: p = begin(bytes); write; offset = end(); draw from buffer() at
+// offset; fence().
+class StreamBuffer {
+public:
+    static const int REGIONS = 3;
+
+    ~StreamBuffer();
+
+    // Moves to the next region, growing the buffer if `bytes` does not fit,
+    // and returns memory for `bytes` of data.
+    void* begin(size_t bytes);
+
+    // Publishes what was written since begin(); returns its offset in buffer().
+    size_t end();
+
+    // Marks the region as in use by the draws issued since end().
+    void fence();
+
+    GLuint buffer() const { return bufferId_; }
+    bool persistent() const { return mapped_ != nullptr; }
+
+    // How often begin() found its region still in use by the GPU.
+    int waitCount() const { return waits_; }
+
+private:
+    GLuint bufferId_ = 0;
+    size_t regionSize_ = 0;
+    int region_ = 0;
+    size_t used_ = 0;
+    unsigned char* mapped_ = nullptr;
+    std::vector<unsigned char> staging_;
+    GLsync fences_[REGIONS] = {};
+    int waits_ = 0;
+
+    void allocate(size_t regionSize);
+    void release();
+};
@@ -0,0 +1,326 @@
+#include "TransformBatch.hpp"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define TRANSFORM_BATCH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang only allow AVX intrinsics in functions built for AVX; MSVC
+// accepts them anywhere.
+#if defined(__GNUC__) || defined(__clang__)
+#define TRANSFORM_BATCH_AVX __attribute__((target("avx")))
+#else
+#define TRANSFORM_BATCH_AVX
+#endif
+
+static_assert(sizeof(glm::vec3) == 12 && sizeof(glm::quat) == 16 && sizeof(glm::mat4) == 64,
+    "TransformBatch expects tightly packed glm types");
+
+namespace TransformBatch {
+namespace {
+
+typedef void (*ComposeFn)(const glm::vec3*, const glm::quat*, const glm::vec3*, glm::mat4*, size_t);
+typedef void (*PropagateFn)(const int*, const glm::mat4*, glm::mat4*, size_t, size_t);
+typedef void (*MultiplyFn)(const float*, const float*, float*);
+
+///////////////////////////////////////////////////////////////////// SCALAR
+
+void composeOne(const glm::vec3& p, const glm::quat& q, const glm::vec3& s, float* m) {
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+    m[0] = (1.0f - 2.0f * (yy + zz)) * s.x;
+    m[1] = 2.0f * (xy + wz) * s.x;
+    m[2] = 2.0f * (xz - wy) * s.x;
+    m[3] = 0.0f;
+    m[4] = 2.0f * (xy - wz) * s.y;
+    m[5] = (1.0f - 2.0f * (xx + zz)) * s.y;
+    m[6] = 2.0f * (yz + wx) * s.y;
+    m[7] = 0.0f;
+    m[8] = 2.0f * (xz + wy) * s.z;
+    m[9] = 2.0f * (yz - wx) * s.z;
+    m[10] = (1.0f - 2.0f * (xx + yy)) * s.z;
+    m[11] = 0.0f;
+    m[12] = p.x;
+    m[13] = p.y;
+    m[14] = p.z;
+    m[15] = 1.0f;
+}
+
+void composeScalar(const glm::vec3* position, const glm::quat* rotation, const glm::vec3* scale, glm::mat4* out,
+    size_t count) {
+    for (size_t i = 0; i < count; i++) composeOne(position[i], rotation[i], scale[i], &out[i][0][0]);
+}
+
+void multiplyScalar(const float* a, const float* b, float* out) {
+    float r[16];
+    for (int j = 0; j < 4; j++) {
+        for (int i = 0; i < 4; i++) {
+            r[4 * j + i] = a[i] * b[4 * j] + a[4 + i] * b[4 * j + 1] + a[8 + i] * b[4 * j + 2] + a[12 + i] * b[4 * j + 3];
+        }
+    }
+    for (int k = 0; k < 16; k++) out[k] = r[k];
+}
+
+void propagateScalar(const int* parent, const glm::mat4* local, glm::mat4* world, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (parent[i] < 0) world[i] = local[i];
+        else multiplyScalar(&world[parent[i]][0][0], &local[i][0][0], &world[i][0][0]);
+    }
+}
+
+#ifdef TRANSFORM_BATCH_X86
+
+//////////////////////////////////////////////////////////////////////// SSE
+
+// Rotation-scale columns of 4 nodes, one node per lane: c[k][r] is row r of
+// column k.
+struct Columns4 {
+    __m128 c[3][3];
+};
+
+inline Columns4 rotationScale4(__m128 qx, __m128 qy, __m128 qz, __m128 qw, __m128 sx, __m128 sy, __m128 sz) {
+    const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+    __m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+    __m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+    __m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+    Columns4 m;
+    m.c[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+    m.c[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+    m.c[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+    m.c[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+    m.c[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+    m.c[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+    m.c[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+    m.c[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+    m.c[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+    return m;
+}
+
+// Transposes one column of 4 nodes back into the 4 output matrices.
+inline void storeColumn4(glm::mat4* out, int column, __m128 x, __m128 y, __m128 z, __m128 w) {
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(&out[0][column][0], x);
+    _mm_storeu_ps(&out[1][column][0], y);
+    _mm_storeu_ps(&out[2][column][0], z);
+    _mm_storeu_ps(&out[3][column][0], w);
+}
+
+// vec3 arrays are gathered lane by lane: a 16-byte load could read past the
+// end of the array.
+inline void load3x4(const glm::vec3* v, __m128& x, __m128& y, __m128& z) {
+    x = _mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x);
+    y = _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y);
+    z = _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z);
+}
+
+inline void loadQuat4(const glm::quat* q, __m128& x, __m128& y, __m128& z, __m128& w) {
+    x = _mm_loadu_ps(&q[0].x);
+    y = _mm_loadu_ps(&q[1].x);
+    z = _mm_loadu_ps(&q[2].x);
+    w = _mm_loadu_ps(&q[3].x);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+}
+
+void composeSse(const glm::vec3* position, const glm::quat* rotation, const glm::vec3* scale, glm::mat4* out,
+    size_t count) {
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128 qx, qy, qz, qw, sx, sy, sz, px, py, pz;
+        loadQuat4(rotation + i, qx, qy, qz, qw);
+        load3x4(scale + i, sx, sy, sz);
+        load3x4(position + i, px, py, pz);
+        Columns4 m = rotationScale4(qx, qy, qz, qw, sx, sy, sz);
+        for (int c = 0; c < 3; c++) storeColumn4(out + i, c, m.c[c][0], m.c[c][1], m.c[c][2], zero);
+        storeColumn4(out + i, 3, px, py, pz, one);
+    }
+    composeScalar(position + i, rotation + i, scale + i, out + i, count - i);
+}
+
+// Column j of a * b is a's columns weighted by the entries of b's column j.
+inline void multiplySse(const float* a, const float* b, float* out) {
+    __m128 a0 = _mm_loadu_ps(a), a1 = _mm_loadu_ps(a + 4), a2 = _mm_loadu_ps(a + 8), a3 = _mm_loadu_ps(a + 12);
+    for (int j = 0; j < 4; j++) {
+        const float* bj = b + 4 * j;
+        __m128 r = _mm_mul_ps(a0, _mm_set1_ps(bj[0]));
+        r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_set1_ps(bj[1])));
+        r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_set1_ps(bj[2])));
+        r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_set1_ps(bj[3])));
+        _mm_storeu_ps(out + 4 * j, r);
+    }
+}
+
+void multiplySseFn(const float* a, const float* b, float* out) {
+    multiplySse(a, b, out);
+}
+
+void propagateSse(const int* parent, const glm::mat4* local, glm::mat4* world, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (parent[i] < 0) world[i] = local[i];
+        else multiplySse(&world[parent[i]][0][0], &local[i][0][0], &world[i][0][0]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////// AVX
+
+TRANSFORM_BATCH_AVX inline __m256 combine(__m128 lo, __m128 hi) {
+    return _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1);
+}
+
+// 8 nodes per step: the inputs are transposed 4 at a time, the arithmetic
+// runs 8 wide, and each output column is split back into two halves.
+TRANSFORM_BATCH_AVX void composeAvx(const glm::vec3* position, const glm::quat* rotation, const glm::vec3* scale,
+    glm::mat4* out, size_t count) {
+    const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f);
+    const __m128 zero4 = _mm_setzero_ps(), one4 = _mm_set1_ps(1.0f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128 lx, ly, lz, lw, hx, hy, hz, hw;
+        loadQuat4(rotation + i, lx, ly, lz, lw);
+        loadQuat4(rotation + i + 4, hx, hy, hz, hw);
+        __m256 qx = combine(lx, hx), qy = combine(ly, hy), qz = combine(lz, hz), qw = combine(lw, hw);
+        load3x4(scale + i, lx, ly, lz);
+        load3x4(scale + i + 4, hx, hy, hz);
+        __m256 sx = combine(lx, hx), sy = combine(ly, hy), sz = combine(lz, hz);
+
+        __m256 xx = _mm256_mul_ps(qx, qx), yy = _mm256_mul_ps(qy, qy), zz = _mm256_mul_ps(qz, qz);
+        __m256 xy = _mm256_mul_ps(qx, qy), xz = _mm256_mul_ps(qx, qz), yz = _mm256_mul_ps(qy, qz);
+        __m256 wx = _mm256_mul_ps(qw, qx), wy = _mm256_mul_ps(qw, qy), wz = _mm256_mul_ps(qw, qz);
+        __m256 m[3][3];
+        m[0][0] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(yy, zz))), sx);
+        m[0][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xy, wz)), sx);
+        m[0][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xz, wy)), sx);
+        m[1][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(xy, wz)), sy);
+        m[1][1] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, zz))), sy);
+        m[1][2] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(yz, wx)), sy);
+        m[2][0] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_add_ps(xz, wy)), sz);
+        m[2][1] = _mm256_mul_ps(_mm256_mul_ps(two, _mm256_sub_ps(yz, wx)), sz);
+        m[2][2] = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_mul_ps(two, _mm256_add_ps(xx, yy))), sz);
+
+        for (int c = 0; c < 3; c++) {
+            storeColumn4(out + i, c, _mm256_castps256_ps128(m[c][0]), _mm256_castps256_ps128(m[c][1]),
+                _mm256_castps256_ps128(m[c][2]), zero4);
+            storeColumn4(out + i + 4, c, _mm256_extractf128_ps(m[c][0], 1), _mm256_extractf128_ps(m[c][1], 1),
+                _mm256_extractf128_ps(m[c][2], 1), zero4);
+        }
+        __m128 px, py, pz;
+        load3x4(position + i, px, py, pz);
+        storeColumn4(out + i, 3, px, py, pz, one4);
+        load3x4(position + i + 4, px, py, pz);
+        storeColumn4(out + i + 4, 3, px, py, pz, one4);
+    }
+    composeSse(position + i, rotation + i, scale + i, out + i, count - i);
+}
+
+// Two result columns per step: a's columns are repeated in both 128-bit
+// lanes and each lane picks its weights from its own column of b.
+TRANSFORM_BATCH_AVX inline void multiplyAvx(const float* a, const float* b, float* out) {
+    __m256 a0 = _mm256_broadcast_ps((const __m128*)a), a1 = _mm256_broadcast_ps((const __m128*)(a + 4));
+    __m256 a2 = _mm256_broadcast_ps((const __m128*)(a + 8)), a3 = _mm256_broadcast_ps((const __m128*)(a + 12));
+    for (int j = 0; j < 2; j++) {
+        __m256 bj = _mm256_loadu_ps(b + 8 * j);
+        __m256 r = _mm256_mul_ps(a0, _mm256_shuffle_ps(bj, bj, 0x00));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_shuffle_ps(bj, bj, 0x55)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_shuffle_ps(bj, bj, 0xAA)));
+        r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_shuffle_ps(bj, bj, 0xFF)));
+        _mm256_storeu_ps(out + 8 * j, r);
+    }
+}
+
+TRANSFORM_BATCH_AVX void multiplyAvxFn(const float* a, const float* b, float* out) {
+    multiplyAvx(a, b, out);
+}
+
+TRANSFORM_BATCH_AVX void propagateAvx(const int* parent, const glm::mat4* local, glm::mat4* world, size_t begin,
+    size_t end) {
+    for (size_t i = begin; i < end; i++) {
+        if (parent[i] < 0) world[i] = local[i];
+        else multiplyAvx(&world[parent[i]][0][0], &local[i][0][0], &world[i][0][0]);
+    }
+}
+
+bool cpuHasAvx() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    // The OS must also save the upper halves of the registers.
+    return osxsave && avx && (_xgetbv(0) & 6) == 6;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx");
+#endif
+}
+
+#endif
+
+struct Kernels {
+    Kernel kernel;
+    ComposeFn compose;
+    PropagateFn propagate;
+    MultiplyFn multiply;
+};
+
+Kernels kernelsFor(Kernel kernel) {
+#ifdef TRANSFORM_BATCH_X86
+    if (kernel == AVX) return { AVX, composeAvx, propagateAvx, multiplyAvxFn };
+    if (kernel == SSE) return { SSE, composeSse, propagateSse, multiplySseFn };
+#endif
+    return { SCALAR, composeScalar, propagateScalar, multiplyScalar };
+}
+
+Kernels& active() {
+    static Kernels kernels = kernelsFor(bestKernel());
+    return kernels;
+}
+
+}
+
+Kernel bestKernel() {
+#ifdef TRANSFORM_BATCH_X86
+    static const Kernel best = cpuHasAvx() ? AVX : SSE;
+    return best;
+#else
+    return SCALAR;
+#endif
+}
+
+Kernel kernel() {
+    return active().kernel;
+}
+
+void setKernel(Kernel kernel) {
+    active() = kernelsFor(kernel > bestKernel() ? bestKernel() : kernel);
+}
+
+const char* kernelName(Kernel kernel) {
+    switch (kernel) {
+    case AVX: return "AVX";
+    case SSE: return "SSE";
+    default: return "scalar";
+    }
+}
+
+void compose(const glm::vec3* position, const glm::quat* rotation, const glm::vec3* scale, glm::mat4* out,
+    size_t count) {
+    active().compose(position, rotation, scale, out, count);
+}
+
+void propagate(const int* parent, const glm::mat4* local, glm::mat4* world, size_t count) {
+    active().propagate(parent, local, world, 0, count);
+}
+
+void propagate(const int* parent, const glm::mat4* local, glm::mat4* world, size_t begin, size_t end) {
+    active().propagate(parent, local, world, begin, end);
+}
+
+void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out) {
+    active().multiply(&a[0][0], &b[0][0], &out[0][0]);
+}
+
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Batched matrix composition for many nodes at once. Each operation has a
+// scalar, an SSE and an AVX kernel; the best one the CPU supports is picked
+// at first use. SSE and AVX work on 4 and 8 nodes per step, keeping the
+// nodes' components in separate lanes.
+//
+// glm::quat is expected in its default x, y, z, w memory layout.
+namespace TransformBatch {
+
+enum Kernel { SCALAR, SSE, AVX };
+
+// Best kernel supported by this CPU and OS.
+Kernel bestKernel();
+
+// Kernel in use. setKernel() is for benchmarks and checks; a kernel the CPU
+// cannot run falls back to bestKernel(). Not safe to call while another
+// thread is using the batch functions.
+Kernel kernel();
+void setKernel(Kernel kernel);
+const char* kernelName(Kernel kernel);
+
+// out[i] = translate(position[i]) * mat4_cast(rotation[i]) * scale(scale[i]).
+// Rotations must be unit quaternions. Scene keeps whole local matrices, so
+// for now only --bench-transforms calls this.
+void compose(const glm::vec3* position, const glm::quat* rotation, const glm::vec3* scale, glm::mat4* out,
+    size_t count);
+
+// world[i] = local[i] for roots (parent[i] < 0), otherwise
+// world[parent[i]] * local[i]. Parents must come before their children.
+void propagate(const int* parent, const glm::mat4* local, glm::mat4* world, size_t count);
+// The same for nodes [begin, end) only; parent indices still address the
+// whole arrays, and parents before begin must be up to date.
+void propagate(const int* parent, const glm::mat4* local, glm::mat4* world, size_t begin, size_t end);
+
+// out = a * b; out may alias a or b.
+void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out);
+
+}
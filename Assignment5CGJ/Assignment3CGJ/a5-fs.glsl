@@ -2,35 +2,96 @@
 
 in vec3 exPosition;
 in vec3 exNormal;
+in vec3 exColor;
 
 out vec4 FragmentColor;
 
-uniform vec3 uColor;
 uniform vec3 uLightPos;
 uniform vec3 uLightColor;
 uniform vec3 uViewPos;
 
-void main(void)
+#ifdef TILED_LIGHTS
+// Written by LightGrid: two texels per light, (position, radius) and
+// (colour, intensity); per screen tile, the (first, count) range of its
+// entries in uLightIndices.
+uniform samplerBuffer uLights;
+uniform usamplerBuffer uLightTiles;
+uniform usamplerBuffer uLightIndices;
+uniform int uTileSize;
+uniform int uTilesX;
+#endif
+
+#ifdef SHADOWS
+// Written by ShadowMap: distance to the nearest caster over uShadowRadius,
+// per direction from the shadowed light; uShadowLight is its index among
+// the tiled lights, or -1.
+uniform samplerCubeShadow uShadowMap;
+uniform float uShadowRadius;
+uniform int uShadowLight;
+
+// 1 where the light reaches the fragment. The lookup point is pushed out
+// along the normal so surfaces do not shadow themselves.
+float shadow(vec3 norm, vec3 lightPos)
 {
-    float ambientStrength = 0.2;
+    vec3 fromLight = exPosition + 0.02 * norm - lightPos;
+    float depth = length(fromLight) / uShadowRadius;
+    if (depth >= 1.0) return 1.0;
+    return texture(uShadowMap, vec4(fromLight, depth - 0.002));
+}
+#endif
+
+vec3 shade(vec3 norm, vec3 lightPos, vec3 lightColor)
+{
+    vec3 lightDir = normalize(lightPos - exPosition);
+    float diff = max(dot(norm, lightDir), 0.0);
+    vec3 result = diff * lightColor;
+
+#ifdef SPECULAR
     float specularStrength = 0.5;
     float shininess = 128.0;
+    vec3 viewDir = normalize(uViewPos - exPosition);
+    vec3 halfwayDir = normalize(lightDir + viewDir);
+    float spec = pow(max(dot(norm, halfwayDir), 0.0), shininess);
+    result += specularStrength * spec * lightColor;
+#endif
+
+    return result;
+}
+
+void main(void)
+{
+    float ambientStrength = 0.2;
 
 
     vec3 ambient = ambientStrength * uLightColor;
 
 
     vec3 norm = normalize(exNormal);
-    vec3 lightDir = normalize(uLightPos - exPosition);
-    float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = diff * uLightColor;
-
+    vec3 result = ambient;
 
-    vec3 viewDir = normalize(uViewPos - exPosition);
-    vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(norm, halfwayDir), 0.0), shininess);
-    vec3 specular = specularStrength * spec * uLightColor;
+#ifdef TILED_LIGHTS
+    ivec2 tile = ivec2(gl_FragCoord.xy) / uTileSize;
+    uvec2 range = texelFetch(uLightTiles, tile.y * uTilesX + tile.x).xy;
+    for (uint i = 0u; i < range.y; i++) {
+        int light = int(texelFetch(uLightIndices, int(range.x + i)).x);
+        vec4 positionRadius = texelFetch(uLights, 2 * light);
+        vec4 colorIntensity = texelFetch(uLights, 2 * light + 1);
+        vec3 toLight = positionRadius.xyz - exPosition;
+        float falloff = clamp(1.0 - dot(toLight, toLight) / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+        vec3 lit = falloff * falloff * shade(norm, positionRadius.xyz, colorIntensity.rgb * colorIntensity.a);
+#ifdef SHADOWS
+        if (light == uShadowLight) lit *= shadow(norm, positionRadius.xyz);
+#endif
+        result += lit;
+    }
+#else
+    vec3 lit = shade(norm, uLightPos, uLightColor);
+#ifdef SHADOWS
+    lit *= shadow(norm, uLightPos);
+#endif
+    result += lit;
+#endif
 
-    vec3 result = (ambient + diffuse + specular) * uColor;
+    result *= exColor;
     FragmentColor = vec4(result, 1.0);
 }
\ No newline at end of file
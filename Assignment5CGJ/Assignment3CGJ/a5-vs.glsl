@@ -4,27 +4,54 @@ layout(location = 1) in vec3 inPosition;
 layout(location = 2) in vec3 inNormal;
 layout(location = 3) in vec2 inTexcoord;
 
+// Quantized meshes (MeshBuffers::PACKED) leave inNormal disabled, and
+// MeshBuffers::bindVertexArray() sets its constant value to zero; they
+// supply an octahedral normal here instead.
+layout(location = 13) in vec2 inPackedNormal;
+
 out vec3 exPosition;
 out vec3 exNormal;
 out vec2 exTexcoord;
+out vec3 exColor;
 
 uniform mat4 ModelMatrix;
+uniform vec3 uColor;
+
+// Inverse transpose of ModelMatrix, computed once per node on the CPU.
+#ifdef NORMAL_MATRIX
+uniform mat3 NormalMatrix;
+#endif
 
 uniform Camera {
     mat4 ViewMatrix;
     mat4 ProjectionMatrix;
 };
 
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
 void main(void)
 {
+    vec3 normal = dot(inNormal, inNormal) > 0.0 ? inNormal : octDecode(inPackedNormal);
 
     exPosition = vec3(ModelMatrix * vec4(inPosition, 1.0));
 
 
-    exNormal = mat3(transpose(inverse(ModelMatrix))) * inNormal;
+#ifdef NORMAL_MATRIX
+    exNormal = NormalMatrix * normal;
+#else
+    exNormal = mat3(transpose(inverse(ModelMatrix))) * normal;
+#endif
 
     exTexcoord = inTexcoord;
 
+    exColor = uColor;
+
 
     gl_Position = ProjectionMatrix * ViewMatrix * ModelMatrix * vec4(inPosition, 1.0);
 }
\ No newline at end of file
@@ -9,194 +9,262 @@
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-#include "../mgl/mgl.hpp"
-#include "../mgl/mglSceneNode.hpp"
+#include "Benchmark.hpp"
+#include "HeapStats.hpp"
+#include "MyApp.hpp"
+#include "SceneTools.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <iostream>
+#include <random>
 
 
-////////////////////////////////////////////////////////////////////////// MYAPP
-
-class MyApp : public mgl::App {
-public:
-    void initCallback(GLFWwindow* win) override;
-    void displayCallback(GLFWwindow* win, double elapsed) override;
-    void windowSizeCallback(GLFWwindow* win, int width, int height) override;
-    void keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods) override;
-    void scrollCallback(GLFWwindow* win, double xoffset, double yoffset) override;
-    void mouseButtonCallback(GLFWwindow* win, int button, int action, int mods) override;
-    void cursorCallback(GLFWwindow* window, double xpos, double ypos) override;
-
-private:
-    // Camera control parameters
-    mgl::Camera* Camera = nullptr;
-    const float zoomSpeed = 1.0f;
-    const float minRadius = 2.0f;
-    const float maxRadius = 50.0f;
-    struct CameraInfo {
-        glm::mat4 viewMatrix;
-        glm::mat4 projectionMatrix;
-        glm::quat rotation;
-        float radius;
-        bool isOrtho;
-    };
-    CameraInfo cam1;
-    CameraInfo* activeCam = nullptr;
-    glm::vec3 target = glm::vec3(0.0f, 0.5f, 0.0f);
-
-    // Mouse control parameters
-    bool rightMousePressed = false;
-    bool leftMousePressed = false;
-    float panSpeed = 0.01f;
-    double lastCameraPosX = 0.0f;
-    double lastCameraPosY = 0.0f;
-    float rotationSpeed = 0.006f;
-    float pitchLimit = glm::radians(89.0f);
-
-    // Shader program
-    const GLuint UBO_BP = 0;
-    mgl::ShaderProgram* Shaders = nullptr;
-
-    // Model matrix uniform location
-    GLint ModelMatrixId;
-    GLint LightPosId;
-    GLint ViewPosId;
-    GLint LightColorId;
-
-    // Meshes
-    std::vector<mgl::Mesh*> MeshesList;
-	mgl::Mesh* woodenSwordMesh = nullptr;
-    mgl::Mesh* candleMesh = nullptr;
-    mgl::Mesh* pedestalMesh = nullptr;
-
-    // Scene Graph
-    mgl::SceneNode* root = nullptr;
-    mgl::SceneNode* woodenSwordNode = nullptr;
-    mgl::SceneNode* candleNode = nullptr;
-    mgl::SceneNode* pedestalNode = nullptr;
-    std::vector<mgl::SceneNode*> nodes;
-
-    // Modos de Edio
-    enum OpMode { NONE, TRANSLATE, ROTATE, SCALE };
-    enum Axis { AXIS_X, AXIS_Y, AXIS_Z };
-
-    OpMode currentMode = NONE;      // Comea sem fazer nada
-    Axis currentAxis = AXIS_X;      // Eixo default
-    mgl::SceneNode* selectedNode = nullptr; // Quem est selecionado?
-
-    // Rato
-    bool isDragging = false;
-    double lastMouseX = 0.0;
-    double lastMouseY = 0.0;
-
-    void createMeshes();
-    void createShaderPrograms();
-    void createCamera();
-    void drawScene();
-    void updateCamera();
-    glm::mat4 getModel(glm::vec3 pos, float rotX, float rotY, float rotZ, float scal);
-    void drawMesh(mgl::Mesh* m, glm::vec3 pos, float rotX, float rotY, float rotZ, float scal);
-    void createSceneGraph();
-    static void calculateProjection(CameraInfo& cam, int width, int height);
-    int pickObject(GLFWwindow* win, double mouseX, double mouseY);
-};
-
 ///////////////////////////////////////////////////////////////////////// MESHES
 
-void MyApp::createMeshes() {
-    std::string mesh_dir = "./assets/models/";
-    /*
-    std::vector<std::string> files = {
-        "Table.obj",
-        "Triangle1.obj",
-        "Triangle2.obj",
-        "Triangle4.obj",
-        "Triangle6.obj",
-        "Triangle7.obj",
-        "Paralelogram3a.obj",
-        "Cube5.obj"
-    };
+bool MyApp::createMeshes() {
+    auto start = std::chrono::steady_clock::now();
+    if (!sceneDesc.load(scenePath)) {
+        std::cerr << "Scene " << scenePath << " could not be loaded" << std::endl;
+        return false;
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Scene " << scenePath << ": " << sceneDesc.nodes.size() << " nodes, " << sceneDesc.meshes.size()
+        << " meshes, parsed in " << ms << " ms" << std::endl;
+
+    // Queued on the loader pool; drawn and pickable once uploaded.
+    sceneMeshes.clear();
+    for (const std::string& path : sceneDesc.meshes) sceneMeshes.push_back(meshLibrary.acquire(path));
+    return true;
+}
+
 
-    for (const auto& f : files) {
-        mgl::Mesh* m = new mgl::Mesh();
-        m->joinIdenticalVertices();
-        m->create(mesh_dir + f);
-        MeshesList.push_back(m);
+///////////////////////////////////////////////////////////////////////// SHADER
+
+void MyApp::createShaderPrograms() {
+    const std::vector<std::string> features = { "SPECULAR", "NORMAL_MATRIX", "TILED_LIGHTS", "SHADOWS" };
+
+    ShaderVariants.reset(new ShaderPermutations("a5-vs.glsl", "a5-fs.glsl", features,
+        [this](mgl::ShaderProgram* program, unsigned enabled) {
+            program->addAttribute(mgl::POSITION_ATTRIBUTE, mgl::Mesh::POSITION);
+            program->addAttribute(mgl::NORMAL_ATTRIBUTE, mgl::Mesh::NORMAL);
+            program->addAttribute(mgl::TEXCOORD_ATTRIBUTE, mgl::Mesh::TEXCOORD);
+            program->addAttribute(mgl::TANGENT_ATTRIBUTE, mgl::Mesh::TANGENT);
+            program->addAttribute("inPackedNormal", MeshBuffers::PACKED_NORMAL_ATTRIBUTE);
+
+            program->addUniform(mgl::MODEL_MATRIX);
+            if (enabled & NORMAL_MATRIX) program->addUniform("NormalMatrix");
+            program->addUniform("uColor");
+            program->addUniform("uLightPos");
+            program->addUniform("uViewPos");
+            program->addUniform("uLightColor");
+            if (enabled & TILED_LIGHTS) addLightGridUniforms(program);
+            if (enabled & SHADOWS) addShadowUniforms(program);
+            program->addUniformBlock(mgl::CAMERA_BLOCK, UBO_BP);
+        }));
+
+    // Same lighting, but model matrix and colour come from instance attributes
+    InstancedShaderVariants.reset(new ShaderPermutations("a5-instanced-vs.glsl", "a5-fs.glsl", features,
+        [this](mgl::ShaderProgram* program, unsigned enabled) {
+            program->addAttribute(mgl::POSITION_ATTRIBUTE, mgl::Mesh::POSITION);
+            program->addAttribute(mgl::NORMAL_ATTRIBUTE, mgl::Mesh::NORMAL);
+            program->addAttribute(mgl::TEXCOORD_ATTRIBUTE, mgl::Mesh::TEXCOORD);
+            program->addAttribute("inPackedNormal", MeshBuffers::PACKED_NORMAL_ATTRIBUTE);
+            program->addAttribute("inModelMatrix", InstanceBatcher::MODEL_MATRIX_ATTRIBUTE);
+            program->addAttribute("inColor", InstanceBatcher::COLOR_ATTRIBUTE);
+            if (enabled & NORMAL_MATRIX) program->addAttribute("inNormalMatrix", InstanceBatcher::NORMAL_MATRIX_ATTRIBUTE);
+
+            program->addUniform("uLightPos");
+            program->addUniform("uViewPos");
+            program->addUniform("uLightColor");
+            if (enabled & TILED_LIGHTS) addLightGridUniforms(program);
+            if (enabled & SHADOWS) addShadowUniforms(program);
+            program->addUniformBlock(mgl::CAMERA_BLOCK, UBO_BP);
+        }));
+
+    selectShaders();
+    // The other variants load from the shader cache, or compile in the
+    // background, so the first toggle does not stall.
+    for (unsigned f = 0; f < (1u << features.size()); f++) {
+        ShaderVariants->prepare(f);
+        InstancedShaderVariants->prepare(f);
     }
-    */
+    occlusionCuller.create();
+    shadowMap.create();
+}
 
-    woodenSwordMesh = new mgl::Mesh();
-    woodenSwordMesh->joinIdenticalVertices();
-    woodenSwordMesh->create(mesh_dir + "wooden_sword.obj");
+void MyApp::addLightGridUniforms(mgl::ShaderProgram* program) {
+    program->addUniform("uLights");
+    program->addUniform("uLightTiles");
+    program->addUniform("uLightIndices");
+    program->addUniform("uTileSize");
+    program->addUniform("uTilesX");
+}
 
-    candleMesh = new mgl::Mesh();
-    candleMesh->joinIdenticalVertices();
-    candleMesh->create(mesh_dir + "candle.obj");
+void MyApp::addShadowUniforms(mgl::ShaderProgram* program) {
+    program->addUniform("uShadowMap");
+    program->addUniform("uShadowRadius");
+    program->addUniform("uShadowLight");
+}
 
-    pedestalMesh = new mgl::Mesh();
-    pedestalMesh->joinIdenticalVertices();
-    pedestalMesh->create(mesh_dir + "pedestal.obj");
+// Switches to the permutations for shadingFeatures and moves every scene
+// node over to them. Only the first call waits for them to build; later ones
+// keep the current variants until the new ones are ready, and are repeated
+// every frame until then.
+void MyApp::selectShaders() {
+    mgl::ShaderProgram* previous = Shaders;
+    mgl::ShaderProgram* shaders = nullptr;
+    mgl::ShaderProgram* instanced = nullptr;
+    if (!previous) {
+        shaders = ShaderVariants->get(shadingFeatures);
+        instanced = InstancedShaderVariants->get(shadingFeatures);
+    }
+    else {
+        shaders = ShaderVariants->ready(shadingFeatures);
+        instanced = InstancedShaderVariants->ready(shadingFeatures);
+    }
+    if (!shaders || !instanced) {
+        if (ShaderVariants->building(shadingFeatures) || InstancedShaderVariants->building(shadingFeatures)) {
+            requestRedraw();
+            return;
+        }
+        std::cerr << "Shader variant " << shadingFeatures << " failed to build" << std::endl;
+        shadingFeatures = activeFeatures;
+        return;
+    }
+
+    Shaders = shaders;
+    InstancedShaders = instanced;
+    activeFeatures = shadingFeatures;
+    locateUniforms();
+    batcher.addVariant(Shaders, InstancedShaders);
+    renderQueue.addVariant(Shaders, InstancedShaders);
+    if (previous && previous != Shaders) scene.replaceShader(previous, Shaders);
 }
 
 
-///////////////////////////////////////////////////////////////////////// SHADER
+// One pass over the description: parents come first, so every node can be
+// linked to an already created parent.
+void MyApp::createSceneGraph() {
+    auto start = std::chrono::steady_clock::now();
+    size_t count = sceneDesc.nodes.size();
+    sceneNodes.clear();
+    scene.clear();
+    scene.reserve(count);
+    picker.clear();
+
+    for (size_t i = 0; i < count; i++) {
+        const SceneDesc::Node& desc = sceneDesc.nodes[i];
+        mgl::SceneNode* node = sceneNodes.create(nullptr, Shaders);
+        node->transform = desc.transform;
+
+        mgl::SceneNode* parent = desc.parent < 0 ? nullptr : &sceneNodes[desc.parent];
+        MeshBuffers* mesh = desc.mesh < 0 ? nullptr : sceneMeshes[desc.mesh].mesh();
+        scene.add(node, parent, mesh, desc.color, Shaders);
+        if (mesh) picker.add(node, sceneMeshes[desc.mesh].bvh(), desc.name);
+    }
 
-void MyApp::createShaderPrograms() {
-    Shaders = new mgl::ShaderProgram();
-    Shaders->addShader(GL_VERTEX_SHADER, "a5-vs.glsl");
-    Shaders->addShader(GL_FRAGMENT_SHADER, "a5-fs.glsl");
+    // Every candle carries a light.
+    candleNodes.clear();
+    for (size_t i = 0; i < count; i++) {
+        int mesh = sceneDesc.nodes[i].mesh;
+        if (mesh >= 0 && sceneDesc.meshes[mesh].find("candle.obj") != std::string::npos) {
+            candleNodes.push_back(&sceneNodes[i]);
+        }
+    }
 
-    Shaders->addAttribute(mgl::POSITION_ATTRIBUTE, mgl::Mesh::POSITION);
-    Shaders->addAttribute(mgl::NORMAL_ATTRIBUTE, mgl::Mesh::NORMAL);
-    Shaders->addAttribute(mgl::TEXCOORD_ATTRIBUTE, mgl::Mesh::TEXCOORD);
-    Shaders->addAttribute(mgl::TANGENT_ATTRIBUTE, mgl::Mesh::TANGENT);
+    int candle = sceneDesc.findNode("VELA");
+    candleNode = candle < 0 ? nullptr : &sceneNodes[candle];
+    shadowMap.invalidate();
 
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Scene graph built in " << ms << " ms" << std::endl;
+}
 
-    Shaders->addUniform(mgl::MODEL_MATRIX);
-    Shaders->addUniform("uColor");
-    Shaders->addUniform("uLightPos");
-    Shaders->addUniform("uViewPos");
-    Shaders->addUniform("uLightColor");
-    Shaders->addUniformBlock(mgl::CAMERA_BLOCK, UBO_BP);
+// Rebuilds everything from scenePath. The new scene takes its mesh handles
+// before the old ones are dropped, so meshes both use stay loaded.
+void MyApp::reloadScene() {
+    std::vector<MeshLibrary::Handle> previous;
+    previous.swap(sceneMeshes);
+    SceneDesc previousDesc = sceneDesc;
+    loadStart = std::chrono::steady_clock::now();
+    if (!createMeshes()) {
+        sceneMeshes.swap(previous);
+        sceneDesc = std::move(previousDesc);
+        return;
+    }
+    selectedNode = nullptr;
+    isDragging = false;
+    createSceneGraph();
+    occlusionCuller.reset(scene);
+    previous.clear();
+    int freed = meshLibrary.collect();
+    watchAssets();
+    std::cout << "Scene reloaded: " << freed << " meshes freed, " << meshLibrary.size() << " in use" << std::endl;
+}
 
-    Shaders->create();
+void MyApp::watchAssets() {
+    watcher.clear();
+    for (const std::string& path : sceneDesc.meshes) watcher.watch(path);
+    for (ShaderPermutations* variants : { ShaderVariants.get(), InstancedShaderVariants.get() }) {
+        watcher.watch(variants->vertexFile());
+        watcher.watch(variants->fragmentFile());
+    }
+}
 
-    ModelMatrixId = Shaders->Uniforms[mgl::MODEL_MATRIX].index;
-    LightPosId = Shaders->Uniforms["uLightPos"].index;
-    ViewPosId = Shaders->Uniforms["uViewPos"].index;
-    LightColorId = Shaders->Uniforms["uLightColor"].index;
+void MyApp::reloadAsset(const std::string& path) {
+    requestRedraw();
+    if (meshLibrary.reload(path)) {
+        std::cout << "Reloading mesh " << path << std::endl;
+        loadStart = std::chrono::steady_clock::now();
+        return;
+    }
+    for (ShaderPermutations* variants : { ShaderVariants.get(), InstancedShaderVariants.get() }) {
+        if (variants->uses(path)) variants->reload();
+    }
+    std::cout << "Reloading shader " << path << std::endl;
+    shaderReloadStart = std::chrono::steady_clock::now();
 }
 
+// GL objects go while the context is still current; the engine destroys it
+// once the window has closed.
+void MyApp::releaseResources() {
+    closing = true;
+    selectedNode = nullptr;
+    candleNode = nullptr;
+    candleNodes.clear();
+    picker.clear();
+    scene.clear();
+    sceneNodes.release();
+    sceneMeshes.clear();
+    meshLibrary.collect();
+    occlusionCuller.release();
+    shadowMap.release();
+    Shaders = nullptr;
+    InstancedShaders = nullptr;
+    ShaderVariants.reset();
+    InstancedShaderVariants.reset();
+    Camera.reset();
+}
 
-void MyApp::createSceneGraph() {
-    root = new mgl::SceneNode(nullptr, nullptr);
-
-
-
-    TangramPiece* pedestal = new TangramPiece(pedestalMesh, glm::vec4(0.6f, 0.4f, 0.2f, 1.0f));
-    pedestalNode = new mgl::SceneNode(pedestal, Shaders);
-    pedestalNode->transform = glm::mat4(1.0f);
-    pedestalNode->transform[3] = glm::vec4(5.0f, 1.0f, 3.0f, 1.0f);
-    root->addChild(pedestalNode);
-    
-    TangramPiece* woodenSword = new TangramPiece(woodenSwordMesh, glm::vec4(0.2f, 0.4f, 0.8f, 1.0f));
-    woodenSwordNode = new mgl::SceneNode(woodenSword, Shaders);
-    glm::mat4 m = glm::mat4(1.0f);
-    m = glm::translate(m, glm::vec3(0.0f, 10.0f, 0.0f));
-    m = glm::rotate(m, glm::radians(180.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    woodenSwordNode->setTransform(m);
-    pedestalNode->addChild(woodenSwordNode);
-    
-    TangramPiece* candle = new TangramPiece(candleMesh, glm::vec4(0.1f, 0.5f, 0.2f, 1.0f));
-    candleNode = new mgl::SceneNode(candle, Shaders);
-	candleNode->setTransform(glm::mat4(1.0f));
-    root->addChild(candleNode);
+// Writes the current local transforms (including edits) back out.
+void MyApp::saveScene() {
+    if (sceneDesc.nodes.size() != sceneNodes.size()) {
+        std::cerr << "Scene description does not match the scene graph; not saved" << std::endl;
+        return;
+    }
+    for (size_t i = 0; i < sceneNodes.size(); i++) {
+        sceneDesc.nodes[i].transform = scene.localTransform(&sceneNodes[i]);
+    }
+    if (sceneDesc.save(editedScenePath)) std::cout << "Scene saved to " << editedScenePath << std::endl;
+    else std::cerr << "Cannot write " << editedScenePath << std::endl;
 }
 
 ///////////////////////////////////////////////////////////////////////// CAMERA
 
 
 void MyApp::createCamera() {
-    Camera = new mgl::Camera(UBO_BP);
+    Camera.reset(new mgl::Camera(UBO_BP));
 
     // --- SETUP CAM 1 ---
     glm::vec3 eye1(0.0f, 10.0f, 0.0f);
@@ -233,8 +301,42 @@ void MyApp::drawMesh(mgl::Mesh* m, glm::vec3 pos, float rotX, float rotY, float
     m->draw();
 }
 
+// Again after a reload, which may move them.
+void MyApp::locateUniforms() {
+    ModelMatrixId = Shaders->Uniforms[mgl::MODEL_MATRIX].index;
+    ShaderUniforms = locateLighting(Shaders);
+    InstancedUniforms = locateLighting(InstancedShaders);
+    renderQueue.resetBindings();
+}
+
+MyApp::LightingUniforms MyApp::locateLighting(mgl::ShaderProgram* program) {
+    LightingUniforms uniforms;
+    uniforms.viewPos = program->Uniforms["uViewPos"].index;
+    uniforms.lightPos = program->Uniforms["uLightPos"].index;
+    uniforms.lightColor = program->Uniforms["uLightColor"].index;
+    uniforms.grid = LightGrid::locate(program);
+    if (program->isUniform("uShadowMap")) uniforms.shadowMap = program->Uniforms["uShadowMap"].index;
+    if (program->isUniform("uShadowRadius")) uniforms.shadowRadius = program->Uniforms["uShadowRadius"].index;
+    if (program->isUniform("uShadowLight")) uniforms.shadowLight = program->Uniforms["uShadowLight"].index;
+    return uniforms;
+}
+
+void MyApp::uploadLighting(mgl::ShaderProgram* program, const LightingUniforms& uniforms, const glm::vec3& viewPos,
+    const glm::vec3& lightPos, int shadowLight) {
+    program->bind();
+    glUniform3fv(uniforms.viewPos, 1, glm::value_ptr(viewPos));
+    glUniform3fv(uniforms.lightPos, 1, glm::value_ptr(lightPos));
+    glUniform3f(uniforms.lightColor, 1.0f, 0.9f, 0.6f);
+    if (uniforms.shadowMap >= 0) glUniform1i(uniforms.shadowMap, ShadowMap::TEXTURE_UNIT);
+    if (uniforms.shadowRadius >= 0) glUniform1f(uniforms.shadowRadius, candleRadius);
+    if (uniforms.shadowLight >= 0) glUniform1i(uniforms.shadowLight, shadowLight);
+}
+
 void MyApp::drawScene() {
-    Shaders->bind();
+    {
+        Profiler::Scope scope(profiler, prof.update);
+        scene.update();
+    }
 
     glm::vec3 camPos;
     if (activeCam) {
@@ -242,16 +344,70 @@ void MyApp::drawScene() {
         glm::vec3 initialPos(0.0f, 0.0f, activeCam->radius);
         camPos = activeCam->rotation * initialPos + target;
     }
-    glUniform3fv(ViewPosId, 1, glm::value_ptr(camPos));
-
     glm::vec4 localFlamePos = glm::vec4(0.0f, 0.75f, 0.0f, 1.0f);
-    glm::vec3 globalFlamePos = glm::vec3(candleNode->getTransform() * localFlamePos);
-
+    glm::vec3 globalFlamePos = glm::vec3(scene.worldTransform(candleNode) * localFlamePos);
+
+    // The tiled lights start with one per candle, in candleNodes order.
+    auto shadowed = std::find(candleNodes.begin(), candleNodes.end(), candleNode);
+    int shadowLight = shadowed == candleNodes.end() ? -1 : (int)(shadowed - candleNodes.begin());
+    uploadLighting(Shaders, ShaderUniforms, camPos, globalFlamePos, shadowLight);
+    uploadLighting(InstancedShaders, InstancedUniforms, camPos, globalFlamePos, shadowLight);
+    if (activeFeatures & TILED_LIGHTS) {
+        Profiler::Scope scope(profiler, prof.lights);
+        lights.clear();
+        for (mgl::SceneNode* node : candleNodes) {
+            glm::vec3 flame = glm::vec3(scene.worldTransform(node) * localFlamePos);
+            lights.push_back({ flame, candleRadius, glm::vec3(1.0f, 0.9f, 0.6f), 1.0f });
+        }
+        lights.insert(lights.end(), extraLights.begin(), extraLights.end());
+        lightGrid.build(lights, activeCam->viewMatrix, activeCam->projectionMatrix, viewportWidth, viewportHeight);
+        lightGrid.upload();
+        lightGrid.bind(Shaders, ShaderUniforms.grid);
+        lightGrid.bind(InstancedShaders, InstancedUniforms.grid);
+        profiler.add(prof.lightsPerTile, lightGrid.averagePerTile());
+    }
+    // Frames without shadows do not track edits, so the cache starts over.
+    if (activeFeatures & SHADOWS) {
+        profiler.begin(prof.gpuShadows);
+        shadowMap.update(scene, globalFlamePos, candleRadius, candleNode);
+        profiler.end(prof.gpuShadows);
+        shadowMap.bind();
+        profiler.add(prof.shadowFaces, shadowMap.facesRendered());
+        profiler.add(prof.shadowCasters, shadowMap.castersDrawn());
+        if (shadowMap.settling()) requestRedraw();
+    }
+    else {
+        shadowMap.invalidate();
+    }
 
-    glUniform3fv(LightPosId, 1, glm::value_ptr(globalFlamePos));
-    glUniform3f(LightColorId, 1.0f, 0.9f, 0.6f);
+    Frustum frustum(activeCam->projectionMatrix * activeCam->viewMatrix);
+    const Frustum* cullFrustum = culling ? &frustum : nullptr;
+    IDrawSink* sink = instancing ? static_cast<IDrawSink*>(&batcher) : &renderQueue;
+    {
+        Profiler::Scope scope(profiler, prof.traversal);
+        Scene::LodView lodView = Scene::lodView(activeCam->viewMatrix, activeCam->projectionMatrix, viewportHeight,
+            activeCam->isOrtho, lodTolerance);
+        if (occlusion) occlusionCuller.update(scene);
+        scene.draw(*sink, cullFrustum, levelOfDetail ? &lodView : nullptr);
+        profiler.add(prof.occludedDraws, scene.occludedCount());
+        profiler.add(prof.occludedTriangles, scene.occludedTriangles());
+    }
 
-    root->draw();
+    Profiler::Scope scope(profiler, prof.submit);
+    profiler.begin(prof.gpuScene);
+    if (instancing) {
+        batcher.flush();
+        profiler.add(prof.drawCalls, batcher.drawCalls());
+        profiler.add(prof.triangles, batcher.triangleCount());
+    }
+    else {
+        renderQueue.flush();
+        profiler.add(prof.drawCalls, renderQueue.stats().draws);
+        profiler.add(prof.triangles, renderQueue.stats().triangles);
+    }
+    // Tested against this frame's depth; the results steer a later frame.
+    if (occlusion) occlusionCuller.issue(scene, activeCam->projectionMatrix * activeCam->viewMatrix);
+    profiler.end(prof.gpuScene);
 }
 
 /////////////////////////////////////////////////////////////////////////// Auxiliary Methods
@@ -264,6 +420,25 @@ void MyApp::updateCamera() {
     activeCam->viewMatrix = view;
 
     Camera->setViewMatrix(activeCam->viewMatrix);
+    requestRedraw();
+}
+
+void MyApp::setOrbit(float yaw, float pitch, float radius) {
+    activeCam->rotation = glm::angleAxis(yaw, glm::vec3(0.0f, 1.0f, 0.0f))
+        * glm::angleAxis(-pitch, glm::vec3(1.0f, 0.0f, 0.0f));
+    activeCam->radius = radius;
+    updateCamera();
+}
+
+void MyApp::setExtraLights(int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    extraLights.clear();
+    for (int i = 0; i < count; i++) {
+        glm::vec3 position = target + glm::vec3(unit(rng) - 0.5f, unit(rng) * 0.5f, unit(rng) - 0.5f) * 12.0f;
+        glm::vec3 color(0.3f + 0.7f * unit(rng), 0.3f + 0.7f * unit(rng), 0.3f + 0.7f * unit(rng));
+        extraLights.push_back({ position, 1.0f + 2.0f * unit(rng), color, 1.0f });
+    }
 }
 
 void MyApp::calculateProjection(CameraInfo& cam, int width, int height) {
@@ -279,72 +454,168 @@ void MyApp::calculateProjection(CameraInfo& cam, int width, int height) {
     }
 }
 
-// Devolve: 0 (Nada), 1 (Vela), 2 (Pedestal)
-// Devolve: 0 (Nada), 1 (Vela), 2 (Pedestal)
-int MyApp::pickObject(GLFWwindow* win, double mouseX, double mouseY) {
-    // 1. Limpar Buffers (incluindo o Stencil!)
-    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-
-    // 2. Ativar Stencil e Configurar
-    glEnable(GL_STENCIL_TEST);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
-
-    // Precisamos do shader ativo
-    Shaders->bind();
-
-    // IMPORTANTE: Se o shader precisar da ViewMatrix atualizada, 
-    // garante que a cmara enviou os dados (normalmente o updateCamera trata disso).
-
-    // --- DESENHAR VELA (ID 1) ---
-    glStencilFunc(GL_ALWAYS, 1, 0xFF);
-    glStencilMask(0xFF);
-    if (candleNode) candleNode->draw();
-
-    // --- DESENHAR PEDESTAL (ID 2) ---
-    glStencilFunc(GL_ALWAYS, 2, 0xFF);
-    if (pedestalNode) pedestalNode->draw();
-
-    // 3. Ler o ID no pixel do rato
+// Devolve o n mais prximo debaixo do rato (ou nullptr), sem tocar na GPU.
+mgl::SceneNode* MyApp::pickObject(GLFWwindow* win, double mouseX, double mouseY) {
     int width, height;
-    glfwGetWindowSize(win, &width, &height); // Usa o 'win' que recebemos
-
-    int x = (int)mouseX;
-    int y = height - (int)mouseY; // Inverter Y
-
-    unsigned int index = 0;
-    glReadPixels(x, y, 1, 1, GL_STENCIL_INDEX, GL_UNSIGNED_INT, &index);
-
-    // 4. Limpar
-    glDisable(GL_STENCIL_TEST);
-
-    return index;
+    glfwGetWindowSize(win, &width, &height);
+    Profiler::Scope scope(profiler, prof.picking);
+    scene.update();
+    return picker.pick(scene, mouseX, mouseY, width, height, activeCam->viewMatrix, activeCam->projectionMatrix);
 }
 
 
 ////////////////////////////////////////////////////////////////////// CALLBACKS
 
 void MyApp::initCallback(GLFWwindow* win) {
+    prof.update = profiler.cpuSection("update");
+    prof.lights = profiler.cpuSection("lights");
+    prof.traversal = profiler.cpuSection("traversal");
+    prof.submit = profiler.cpuSection("submit");
+    prof.picking = profiler.cpuSection("picking");
+    prof.upload = profiler.cpuSection("upload");
+    prof.gpuScene = profiler.gpuSection("gpu");
+    prof.gpuShadows = profiler.gpuSection("gpu shadows");
+    prof.drawCalls = profiler.counter("draw calls");
+    prof.triangles = profiler.counter("triangles");
+    prof.lightsPerTile = profiler.counter("lights per tile");
+    prof.occludedDraws = profiler.counter("occluded draws");
+    prof.occludedTriangles = profiler.counter("occluded triangles");
+    prof.shadowFaces = profiler.counter("shadow faces");
+    prof.shadowCasters = profiler.counter("shadow casters");
+    prof.heapAllocations = profiler.counter("heap allocations");
+
+    loadStart = std::chrono::steady_clock::now();
     createMeshes();
     createShaderPrograms();
     createCamera();
+    scene.setJobSystem(parallel ? &jobs : nullptr);
     createSceneGraph();
+    watchAssets();
 }
 
 void MyApp::windowSizeCallback(GLFWwindow* win, int width, int height) {
+    requestRedraw();
     glViewport(0, 0, width, height);
+    viewportWidth = width;
+    viewportHeight = height;
     calculateProjection(cam1, width, height);
     if (Camera && activeCam) {
         Camera->setProjectionMatrix(activeCam->projectionMatrix);
     }
 }
 
+void MyApp::windowCloseCallback(GLFWwindow* win) {
+    if (profiler.writeCsv(profileCsv)) {
+        std::cout << "Profile written to " << profileCsv << std::endl;
+    }
+    releaseResources();
+}
+
+// Returns the seconds spent waiting. Input callbacks run inside
+// glfwWaitEventsTimeout and request the frame themselves.
+double MyApp::waitForRedraw(GLFWwindow* win) {
+    double start = glfwGetTime();
+    double now = start;
+    while (redrawFrames == 0 && meshLoader.pending() == 0 && !scene.dirty() && !glfwWindowShouldClose(win)) {
+        if (now - start >= idleRedraw) break;
+        glfwWaitEventsTimeout(idleRedraw - (now - start));
+        now = glfwGetTime();
+    }
+    if (scene.dirty()) requestRedraw();
+    if (redrawFrames > 0) redrawFrames--;
+    return glfwGetTime() - start;
+}
+
 void MyApp::displayCallback(GLFWwindow* win, double elapsed) {
+    // `elapsed` runs from the previous frame's start, so it includes that
+    // frame's wait; the profiler only sees the time spent working.
+    double busy = std::max(elapsed - waited, 0.0);
+    waited = onDemand ? waitForRedraw(win) : 0.0;
+    if (closing) return;
+
+    uint64_t allocations = HeapStats::allocations();
+    profiler.beginFrame();
+    watcher.poll(changedFiles);
+    for (const std::string& path : changedFiles) reloadAsset(path);
+    changedFiles.clear();
+    if (meshLoader.pending() > 0) {
+        Profiler::Scope scope(profiler, prof.upload);
+        if (meshLoader.upload(uploadBudget) > 0) {
+            scene.invalidateBounds();
+            shadowMap.invalidate();
+        }
+        if (meshLoader.pending() == 0) {
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+            std::cout << "Meshes loaded in " << ms << " ms (" << meshLoader.fromCacheCount() << "/"
+                << meshLoader.loadedCount() << " from cache)" << std::endl;
+        }
+    }
+    int relinked = ShaderVariants->poll() + InstancedShaderVariants->poll();
+    if (relinked > 0) {
+        locateUniforms();
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now()
+            - shaderReloadStart).count();
+        std::cout << "Shaders reloaded: " << relinked << " variants in " << ms << " ms" << std::endl;
+    }
+    if (ShaderVariants->reloading() || InstancedShaderVariants->reloading()) requestRedraw();
+    if (activeFeatures != shadingFeatures) selectShaders();
     drawScene();
+    lastFrameAllocations = HeapStats::allocations() - allocations;
+    profiler.add(prof.heapAllocations, (double)lastFrameAllocations);
+    profiler.endFrame(busy);
+
+    statsTime += elapsed;
+    statsFrames++;
+    statsRecomputed += scene.recomputedCount();
+    statsAllocations += lastFrameAllocations;
+    if (shadowMap.staticRendered()) statsShadowRenders++;
+    scene.resetStats();
+    if (statsTime >= 1.0) {
+        if (statsRecomputed > 0) {
+            std::cout << "World matrices recomputed: " << statsRecomputed << " in " << statsFrames
+                << " frames (" << scene.size() << " nodes)" << std::endl;
+        }
+        if (statsAllocations > 0) {
+            std::cout << "Heap allocations: " << statsAllocations << " in " << statsFrames << " frames ("
+                << HeapStats::live() << " live)" << std::endl;
+        }
+        if (!instancing) {
+            const RenderQueue::Stats& rq = renderQueue.stats();
+            std::cout << "State changes: " << rq.stateChanges() << " for " << rq.draws << " draws (unsorted: "
+                << rq.unsortedStateChanges << "; programs " << rq.programBinds << ", VAOs " << rq.vaoBinds
+                << ", uniforms " << rq.uniformUploads << "; stream waits " << renderQueue.streamWaits() << ")" << std::endl;
+        }
+        if (culling) {
+            std::cout << "Nodes drawn: " << scene.drawnCount() << ", culled: " << scene.culledCount() << std::endl;
+        }
+        if (levelOfDetail) {
+            std::cout << "Triangles: " << profiler.summary(prof.triangles).avg << " per frame, LOD switches: "
+                << scene.lodSwitchCount() << std::endl;
+        }
+        if (occlusion) {
+            std::cout << "Occluded: " << scene.occludedCount() << " draws, " << scene.occludedTriangles()
+                << " triangles (queries issued " << occlusionCuller.issuedCount() << ", pending "
+                << occlusionCuller.pendingCount() << ")" << std::endl;
+        }
+        if (statsShadowRenders > 0) {
+            std::cout << "Static shadow map rendered " << statsShadowRenders << " times in " << statsFrames
+                << " frames" << std::endl;
+        }
+        if (showProfile) {
+            std::cout << "Profile (last " << Profiler::WINDOW << " frames):" << std::endl;
+            profiler.report(std::cout);
+        }
+        statsTime = 0.0;
+        statsFrames = 0;
+        statsRecomputed = 0;
+        statsAllocations = 0;
+        statsShadowRenders = 0;
+    }
 }
 
 void MyApp::keyCallback(GLFWwindow* win, int key, int scancode, int action, int mods) {
     if (action == GLFW_PRESS) {
+        requestRedraw();
         if (key == GLFW_KEY_G) { currentMode = TRANSLATE; std::cout << ">> Mode: TRANSLATE" << std::endl; }
         if (key == GLFW_KEY_R) { currentMode = ROTATE;    std::cout << ">> Mode: ROTATE" << std::endl; }
         if (key == GLFW_KEY_S) { currentMode = SCALE;     std::cout << ">> Mode: SCALE" << std::endl; }
@@ -361,6 +632,63 @@ void MyApp::keyCallback(GLFWwindow* win, int key, int scancode, int action, int
             std::cout << ">> Mode: NONE (Deselected)" << std::endl;
         }
         switch (key) {
+        case GLFW_KEY_I:
+            instancing = !instancing;
+            std::cout << ">> Instancing: " << (instancing ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_T:
+            showProfile = !showProfile;
+            std::cout << ">> Profile: " << (showProfile ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_F2:
+            saveScene();
+            break;
+        case GLFW_KEY_F5:
+            reloadScene();
+            break;
+        case GLFW_KEY_H:
+            shadingFeatures ^= SPECULAR;
+            selectShaders();
+            std::cout << ">> Specular: " << ((shadingFeatures & SPECULAR) ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_N:
+            shadingFeatures ^= NORMAL_MATRIX;
+            selectShaders();
+            std::cout << ">> Normal matrix: " << ((shadingFeatures & NORMAL_MATRIX) ? "CPU" : "per vertex") << std::endl;
+            break;
+        case GLFW_KEY_L:
+            shadingFeatures ^= TILED_LIGHTS;
+            selectShaders();
+            std::cout << ">> Tiled lights: " << ((shadingFeatures & TILED_LIGHTS) ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_K:
+            shadingFeatures ^= SHADOWS;
+            selectShaders();
+            std::cout << ">> Shadows: " << ((shadingFeatures & SHADOWS) ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_C:
+            culling = !culling;
+            std::cout << ">> Culling: " << (culling ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_O:
+            levelOfDetail = !levelOfDetail;
+            std::cout << ">> Level of detail: " << (levelOfDetail ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_J:
+            parallel = !parallel;
+            scene.setJobSystem(parallel ? &jobs : nullptr);
+            std::cout << ">> Parallel traversal: " << (parallel ? "ON" : "OFF") << " (" << jobs.threadCount()
+                << " threads)" << std::endl;
+            break;
+        case GLFW_KEY_F:
+            onDemand = !onDemand;
+            std::cout << ">> On-demand rendering: " << (onDemand ? "ON" : "OFF") << std::endl;
+            break;
+        case GLFW_KEY_Q:
+            occlusion = !occlusion;
+            if (!occlusion) occlusionCuller.reset(scene);
+            std::cout << ">> Occlusion culling: " << (occlusion ? "ON" : "OFF") << std::endl;
+            break;
         case GLFW_KEY_P:
             activeCam->isOrtho = !activeCam->isOrtho;
             int w, h;
@@ -391,6 +719,7 @@ void MyApp::scrollCallback(GLFWwindow* win, double xoffset, double yoffset) {
 }
 
 void MyApp::mouseButtonCallback(GLFWwindow* win, int button, int action, int mods) {
+    requestRedraw();
     if (button == GLFW_MOUSE_BUTTON_RIGHT) {
         if (action == GLFW_PRESS) {
             rightMousePressed = true;
@@ -409,22 +738,9 @@ void MyApp::mouseButtonCallback(GLFWwindow* win, int button, int action, int mod
             double x, y;
             glfwGetCursorPos(win, &x, &y);
 
-            // 1. Fazer o Picking
-            int id = pickObject(win, x, y);
-
-            // 2. Atualizar quem est selecionado
-            if (id == 1) {
-                selectedNode = candleNode;
-                std::cout << "Selecionado: VELA" << std::endl;
-            }
-            else if (id == 2) {
-                selectedNode = pedestalNode;
-                std::cout << "Selecionado: PEDESTAL" << std::endl;
-            }
-            else {
-                selectedNode = nullptr;
-                std::cout << "Selecionado: NADA" << std::endl;
-            }
+            // 1. Fazer o Picking e atualizar quem est selecionado
+            selectedNode = pickObject(win, x, y);
+            std::cout << "Selecionado: " << picker.nameOf(selectedNode) << std::endl;
 
             // Iniciar arrasto
             isDragging = true;
@@ -505,14 +821,14 @@ void MyApp::cursorCallback(GLFWwindow* window, double xpos, double ypos) {
 
         // 4. Aplicar a Transformao
         if (currentMode == TRANSLATE) {
-            selectedNode->transform = glm::translate(selectedNode->transform, axisVector * value);
+            scene.setLocalTransform(selectedNode, glm::translate(selectedNode->transform, axisVector * value));
         }
         else if (currentMode == ROTATE) {
-            selectedNode->transform = glm::rotate(selectedNode->transform, value * 5.0f, axisVector);
+            scene.setLocalTransform(selectedNode, glm::rotate(selectedNode->transform, value * 5.0f, axisVector));
         }
         else if (currentMode == SCALE) {
             float scaleVal = 1.0f + (value * 0.5f);
-            selectedNode->transform = glm::scale(selectedNode->transform, glm::vec3(scaleVal));
+            scene.setLocalTransform(selectedNode, glm::scale(selectedNode->transform, glm::vec3(scaleVal)));
         }
     }
 
@@ -524,8 +840,33 @@ void MyApp::cursorCallback(GLFWwindow* window, double xpos, double ypos) {
 /////////////////////////////////////////////////////////////////////////// MAIN
 
 int main(int argc, char* argv[]) {
+    if (argc > 1 && std::strcmp(argv[1], "--convert") == 0) {
+        exit(SceneTools::convert(argc - 2, argv + 2));
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--bench") == 0) {
+        exit(Benchmark::run(argc - 2, argv + 2));
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--bench-scene") == 0) {
+        exit(Benchmark::scene(argc > 2 ? std::atoi(argv[2]) : 100000));
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--bench-lights") == 0) {
+        exit(Benchmark::lights(argc - 2, argv + 2));
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--bench-transforms") == 0) {
+        exit(Benchmark::transforms(argc > 2 ? std::atoi(argv[2]) : 100000));
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--bench-spatial") == 0) {
+        exit(Benchmark::spatial(argc > 2 ? std::atoi(argv[2]) : 0));
+    }
+    if (argc > 3 && std::strcmp(argv[1], "--generate-scene") == 0) {
+        exit(SceneTools::generateScene(std::atoi(argv[2]), argv[3]));
+    }
+
+    MyApp* app = new MyApp();
+    if (argc > 2 && std::strcmp(argv[1], "--scene") == 0) app->setScenePath(argv[2]);
+
     mgl::Engine& engine = mgl::Engine::getInstance();
-    engine.setApp(new MyApp());
+    engine.setApp(app);
     engine.setOpenGL(4, 6);
     engine.setWindow(800, 600, "Create Pickagram 3D", 0, 1);
     engine.init();
@@ -0,0 +1,9 @@
+#version 330 core
+
+out vec4 outColor;
+
+// Colour writes are masked off; only the depth test counts.
+void main(void)
+{
+    outColor = vec4(1.0);
+}
\ No newline at end of file
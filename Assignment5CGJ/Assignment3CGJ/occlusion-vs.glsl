@@ -0,0 +1,11 @@
+#version 330 core
+
+layout(location = 1) in vec3 inPosition;
+
+// Unit cube to clip space: view-projection times the box placement.
+uniform mat4 BoxMatrix;
+
+void main(void)
+{
+    gl_Position = BoxMatrix * vec4(inPosition, 1.0);
+}
\ No newline at end of file
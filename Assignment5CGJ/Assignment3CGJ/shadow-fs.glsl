@@ -0,0 +1,13 @@
+#version 330 core
+
+in vec3 exPosition;
+
+uniform vec3 uLightPos;
+uniform float uRadius;
+
+// Distance to the light over its radius, so a lookup in any direction
+// compares distances rather than per-face depths.
+void main(void)
+{
+    gl_FragDepth = length(exPosition - uLightPos) / uRadius;
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 330 core
+
+layout(location = 1) in vec3 inPosition;
+
+out vec3 exPosition;
+
+uniform mat4 ModelMatrix;
+// Projection * view of the cube face being rendered.
+uniform mat4 FaceMatrix;
+
+void main(void)
+{
+    vec4 world = ModelMatrix * vec4(inPosition, 1.0);
+    exPosition = world.xyz;
+    gl_Position = FaceMatrix * world;
+}
\ No newline at end of file